@@ -4,45 +4,74 @@
 
 #include "SimpleLang.h"
 #include "SimpleLangpp.h"
+#include "SimpleLangstats.h"
+#include "SimpleLangparse.h"
+#include "SimpleLangsuper.h"
+#include "SimpleLangrr.h"
+#include "SimpleLangloop.h"
+#include "SimpleLangdebug.h"
+#include "SimpleLangfork.h"
+#include "SimpleLangcell.h"
+#include "SimpleLangnest.h"
+#include "SimpleLangprobe.h"
 
 /*** EXTERNAL VARIABLES ***/
 // SimpleLang++ control variable (SimpleLang mode vs SimpleLang++)
 int bfpp = 0;
+// Multiple file handle extension control variable (@ and $ ops)
+int multifile = 0;
+// Block I/O extension control variable ({ and } ops)
+int blockio = 0;
 // out-of-bounds error control variable, if set to 0, memory will act circular
 int oob = 1;
-// Position in array
-int where = 0;
-// Main memory array
-char memory[BF_ARRAY_SIZE] = {0};
+// Position in array, each --fork thread has its own
+THREAD_LOCAL int where = 0;
+// Main memory array, page aligned so watchpoints can protect it
+char memory[BF_ARRAY_SIZE] __attribute__((aligned(TAPE_PAGE))) = {0};
+// Lowest and highest cells that may have been written since reset_tape()
+int dirty_lo = 0, dirty_hi = 0;
 /**************************/
 
 /*** INTERNAL VARIABLES ***/
 // File and socket control variables
-static char file_open = 0, sock_open = 0;
-// Internal file pointer for SimpleLang
+static char file_open = 0, sock_open = 0, sock_client = 0;
+// Internal file pointer for SimpleLang, this is the active handle in files
 static FILE* bf_fp = NULL;
+// File handle table for the multiple file extension
+static FILE* files[MAX_FILES] = {NULL};
+// Index of the active handle in files
+static int cur_file = 0;
 // Client socket
 static SOCKET sock_c;
 // Server socket
 static SOCKET sock_s = INVALID_SOCKET;
 // Port number for working with servers
 static int port;
+// The code the current thread is running, for forks
+static THREAD_LOCAL char *exec_buf;
+static THREAD_LOCAL int exec_len;
 /**************************/
 
 /* Meant for basic cleanup upon exiting application
  * Closes file pointer and sockets.
  */
 void cleanup() {
-	if(file_open) {
-		fclose(bf_fp);
-		file_open = 0;
+	files[cur_file] = bf_fp;
+	for(int i = 0; i < MAX_FILES; i++) {
+		if(files[i] != NULL) {
+			fclose(files[i]);
+			files[i] = NULL;
+		}
 	}
+	bf_fp = NULL;
+	file_open = 0;
 	if(sock_open) {
 		close_sock(sock_s);
 		sock_s = INVALID_SOCKET;
 		close_sock(sock_c);
 		sock_open = 0;
 	}
+	close_pool();
 }
 
 /* Gets an error message corresponding to an error code
@@ -63,6 +92,14 @@ const char* get_error(int err) {
 			return "Maximum loop depth exceeded";
 		case MEMORY_ERR:
 			return "Allocating memory";
+		case REPLAY_ERR:
+			return "Replay log does not match the program.";
+		case THREAD_ERR:
+			return "Too many threads.";
+		case THREAD_HALT:
+			return "Stopped, another thread failed.";
+		case BREAK_ERR:
+			return "Breakpoint has lost the op it replaced.";
 		default:
 			return "Unimplemented error";
 	}
@@ -116,6 +153,26 @@ switch(help_id) {
 		printf("       failure) is stored at the current cell.\n");
 		printf("   ^   Writes one byte from current cell to socket.\n");
 		printf("   !   Reads one byte from socket to current cell.\n\n");
+		printf("With --multi-file:\n");
+		printf("   @   Makes handle n the active file, where n is the value of the current\n");
+		printf("       cell (0 to 15). #, : and ; work on the active file. The result (0 if\n");
+		printf("       success, -1 if failure) is stored at the current cell.\n");
+		printf("   $   Seeks the active file. The offset is a 4 byte number starting n bytes\n");
+		printf("       away, where n is the value of the current cell. The result (0 if\n");
+		printf("       success, -1 if failure) is stored at the current cell.\n\n");
+		printf("With --block-io:\n");
+		printf("   {   Reads a block. The current cell is the channel (0 stdio, 1 file,\n");
+		printf("       2 socket) and is followed by a 2 byte length and the data. The number\n");
+		printf("       of bytes read replaces the length.\n");
+		printf("   }   Writes a block, with the same layout as {.\n");
+		printf("   &   Sends n bytes of the open file through the socket, where n is the 4\n");
+		printf("       byte number starting at the current cell (0 sends the rest of the\n");
+		printf("       file). The number of bytes sent replaces n.\n\n");
+		printf("With --fork:\n");
+		printf("   Y   Forks a thread that runs on from the next op, on the same tape. The\n");
+		printf("       current cell is set to 0, the new thread's pointer starts one cell\n");
+		printf("       right, and that cell is set to 1.\n");
+		printf("   |   Waits for every thread the current thread forked to end.\n\n");
 		printf("Use \"help bf\" to see general SimpleLang operations\n\n");
 		break;
 	case PRINT_HELP:
@@ -148,81 +205,74 @@ switch(help_id) {
 	}
 }
 
-/* Finds the length of a negative-terminated array (type short)
- * @param arr The short array
- * @return The number of items before the first negative in the array (int)
- */
-int shortlen(short *arr) {
-	short *ptr = arr, len = 0;
-	while(*ptr++ >= 0) ++len;
-	return len;
-}
-
-/* Pushes a short onto a stack (array)
- * @param stack The array pointer
- * @param data The into to push
+/* Checks whether a character is a SimpleLang++ operation in the current mode.
+ * Extension ops only count when their extension is enabled.
+ * @param c The character to check
+ * @return 1 if c is an operation, 0 if it is a comment (int)
  */
-void push(short *stack, short data) {
-	short *tmp = &stack[shortlen(stack)];
-	*tmp = data;
+int bfpp_op(char c) {
+	if(!bfpp) return 0;
+	switch(c) {
+		case '#': case '^': case '!':
+		case ';': case ':': case '%':
+			return 1;
+		case '@': case '$':
+			return multifile;
+		case '{': case '}': case '&':
+			return blockio;
+		case 'Y': case '|':
+			return forking;
+	}
+	return 0;
 }
 
-/* Removes and returns the last element in a stack (array)
- * @param stack The array pointer
- * @return The last element of stack (short)
+/* Gets the size of the parsed form of a source character
+ * @param c The source character
+ * @return The number of bytes c takes in parsed code, 0 for comments (int)
  */
-short pop(short *stack) {
-	int len = shortlen(stack);
-	if(len == 0)
-		return -1;
-	short tmp = stack[len-1];
-	stack[len-1] = -1;
-	return tmp;
+int ir_size(char c) {
+	switch(c) {
+		case '<': case '>': case '+':
+		case '-': case ',': case '.':
+			return 1; // Standard operation
+		case '[': case ']':
+			return 1 + sizeof(int); // Loop ops require a memory address
+		default:
+			// handle any SimpleLang++ code, but only in bf++ mode
+			return bfpp_op(c);
+	}
 }
 
-/* Returns the last element in a stack (array)
- * @param stack The array pointer
- * @return The last element of stack (short)
+/* Gets the size of an op in compiled code, with its operands
+ * @param op The op
+ * @return The size in bytes (int)
  */
-short peek(short *stack) {
-	int len = shortlen(stack);
-	if(len == 0)
-		return -1;
-	return stack[len-1];
+int op_size(char *op) {
+	if(*op == OP_CLOSED || *op == OP_NESTS) return 1 + sizeof(int) + *((int*)&op[1]);
+	return ir_size(*op) ? ir_size(*op) : 1;
 }
 
 /* Parses SimpleLang code to be read by the interpreter.
  * Removes comments/invalid chars, establishes loops, 
+ * Large sources are handed to parse_parallel(), which gives the same result.
+ * On BAD_BRACKETS or LOOP_TOO_DEEP, parse_errpos is set to the position of
+ * the offending bracket in bf.
  * @param bf The SimpleLang code to parse
  * @param arr Pointer to the location to store the modified 
  *				code (if NULL will be created using malloc)
  * @return The length of the newly parsed array
  */
 int parse(char *bf, char **arr) {
+	long len = strlen(bf);
 	int cnt = 0;
-	for(int i = 0; i < strlen(bf); i++) {
-		// Counts the number of actual instructions
-		switch(bf[i]) {
-			case '<': case '>': case '+':
-			case '-': case ',': case '.':
-				cnt += 1; // Standard operation
-				break;
-			case '[': case ']':
-				cnt += 1 + sizeof(short); // Loop ops require a memory address
-				break;
-			default:
-			// handle any SimpleLang++ code, but only in bf++ mode
-				if(bfpp) {
-					switch(bf[i]) {
-						case '#': case '^': case '!':
-						case ';': case ':': case '%':
-							cnt += 1;
-							break;
-					}
-				}
-				break;
-		}
-	}
+
+	if(len >= PAR_PARSE_MIN && parse_threads != 1)
+		return parse_parallel(bf, len, arr);
+
+	// Counts the number of actual instructions
+	for(long i = 0; i < len; i++)
+		cnt += ir_size(bf[i]);
+
 	// Check if an array was provided
 	if(*arr == NULL) {
 		*arr = malloc(cnt); // malloc for formatted code
@@ -237,61 +287,93 @@ int parse(char *bf, char **arr) {
 	char *ptr = *arr;
 	cnt = 0; // reset cnt for loop
 
-#define MAX_LOOPS 128 // Maximum number of nested loops
-	short tmp, loopstack[MAX_LOOPS]; // Stores loop pointers
-
-	for(int i = 0; i < MAX_LOOPS; i++)
-		loopstack[i] = -1;
+	int tmp, depth = 0;
+	int loopstack[MAX_LOOPS]; // Stores loop pointers
+	long srcstack[MAX_LOOPS]; // Stores loop positions in bf, for errors
 
-	for(int i = 0; i < strlen(bf); i++) {
+	for(long i = 0; i < len; i++) {
 		switch(bf[i]) {
-			case '<': case '>': case '+':
-			case '-': case ',': case '.':
-				// Store the operation
-				ptr[cnt] = bf[i];
-				cnt += 1;
-				break;
 			case '[':
 				// Store the operation, push loop address
 				ptr[cnt] = bf[i];
-				push(loopstack, cnt);
+				loopstack[depth] = cnt;
+				srcstack[depth] = i;
 				
-				if(shortlen(loopstack) == MAX_LOOPS)
+				if(++depth == MAX_LOOPS) {
+					parse_errpos = i;
 					return LOOP_TOO_DEEP;
+				}
 				
-				cnt += 1 + sizeof(short); // 1 byte for operator, 2 bytes for address
+				cnt += 1 + sizeof(int); // 1 byte for operator, 4 bytes for address
 				break;
 			case ']':
 				// Store the operation, pop loop address, set address variables
 				ptr[cnt] = bf[i];
-				tmp = pop(loopstack);
-				if(tmp == -1)
+				if(depth == 0) {
+					parse_errpos = i;
 					return BAD_BRACKETS;
-				*((short*)&ptr[cnt+1]) = tmp-cnt;
-				cnt += 1 + sizeof(short);
-				*((short*)&ptr[tmp+1]) = cnt-tmp;
+				}
+				tmp = loopstack[--depth];
+				*((int*)&ptr[cnt+1]) = tmp-cnt;
+				cnt += 1 + sizeof(int);
+				*((int*)&ptr[tmp+1]) = cnt-tmp;
 				break;
 			default:
-			// handle any SimpleLang++ code, but only in bf++ mode
-				if(bfpp) {
-					switch(bf[i]) {
-						case '#': case '^': case '!':
-						case ';': case ':': case '%':
-							ptr[cnt] = bf[i];
-							cnt += 1;
-							break;
-					}
+				// Store the operation, if it is one
+				if(ir_size(bf[i])) {
+					ptr[cnt] = bf[i];
+					cnt += 1;
 				}
 				break;
 		} // End switch
 	} // End for
 
-	if(shortlen(loopstack) > 0)
+	if(depth > 0) {
+		parse_errpos = srcstack[depth-1]; // Innermost unclosed loop
 		return BAD_BRACKETS;
+	}
 
 	return cnt;
 }
 
+/* Marks cells as written outside the pointer, for reset_tape()
+ * @param lo The first cell written
+ * @param hi The last cell written
+ */
+void mark_dirty(int lo, int hi) {
+	if(lo < dirty_lo) dirty_lo = lo;
+	if(hi > dirty_hi) dirty_hi = hi;
+}
+
+/* Clears the tape and moves the pointer back to the first cell. Only the
+ * cells between the lowest and highest the pointer has been are cleared.
+ */
+void reset_tape() {
+	int bytes = cell_bits / 8;
+	memset(&memory[dirty_lo], 0, dirty_hi-dirty_lo+1);
+	if(cell_bits != 8) // The byte tape above only carries wide cells' I/O
+		memset((char*)tape_base() + dirty_lo*bytes, 0, (dirty_hi-dirty_lo+1)*bytes);
+	where = 0;
+	dirty_lo = dirty_hi = 0;
+}
+
+/* Reads a byte of input into the cell at the pointer, for ,
+ */
+static inline void read_char() {
+	if(rr_mode == RR_REPLAY) {
+		rr_replay(',', where);
+		return;
+	}
+	IO_TIME(IO_STDIO, memory[where] = (char)getchar());
+	if(rr_mode == RR_RECORD) rr_record(',', where);
+}
+
+/* Prints the cell at the pointer, for .
+ */
+static inline void write_char() {
+	IO_TIME(IO_STDIO, printf("%c", memory[where]));
+}
+
 /* Perform a single SimpleLang operation. 
  * Passes any SimpleLang++ to do_op_bfpp().
  * @param op The operation
@@ -301,62 +383,158 @@ int do_op(char op, char *next) {
 	int offset = 0;
 	switch(op) {
 		case '+': // Increment cell at pointer
-			++ memory[where];
+			if(forking) __atomic_add_fetch(&memory[where], 1, __ATOMIC_RELAXED);
+			else ++ memory[where];
 			break;
 		case '-': // Decrement cell at pointer
-			-- memory[where];
+			if(forking) __atomic_sub_fetch(&memory[where], 1, __ATOMIC_RELAXED);
+			else -- memory[where];
 			break;
 		case '<': // Move pointer left
 			where --;
+			wrap_where();
 			break;
 		case '>': // Move pointer right
 			where ++;
+			wrap_where();
 			break;
 		case '.': // Print character
-			printf("%c", memory[where]);
+			write_char();
+			STAT_BYTES(op, 1);
 			break;
 		case ',': // Get character
-			memory[where] = (char)getchar();
+			read_char();
+			STAT_BYTES(op, 1);
 			break;
 		case '[': // Begin loop
 			if(memory[where] == 0) {
-				offset = (int)*((short*)next)-1;
+				offset = *((int*)next)-1;
+				PROBE(loop__exit, next-1, where);
 			} else {
-				offset = sizeof(short);
+				offset = sizeof(int);
+				PROBE(loop__enter, next-1, where);
 			}
 			break;
 		case ']': // End loop
-			offset = (int)*((short*)next)-1;
+			offset = *((int*)next)-1;
+			// Every loop passes here, so a failed thread stops the others
+			if(__atomic_load_n(&thread_err, __ATOMIC_RELAXED)) where = THREAD_HALT;
+			break;
+		case OP_CLOSED: // Loop nest with a closed form, see SimpleLangloop.h
+			offset = run_closed(next);
+			break;
+		case OP_BREAK: // Breakpoint, see SimpleLangdebug.h
+			offset = run_break(next);
 			break;
+		case OP_NESTS: // Loop nests that run side by side, see SimpleLangnest.h
+			offset = run_nests(next);
+			break;
+		case 'Y': // Fork, see SimpleLangfork.h
+			run_fork(exec_buf, exec_len, next - exec_buf);
+			break;
+		case '|': // Join
+			run_join();
+			break;
+		SUPEROP_CASES // Fused ops, see SimpleLangsuperops.h
 		default:
 			// Perform any SimpleLang++ operations if in bf++ mode
 			if(bfpp) do_op_bfpp(op);
 			break;
 	}
-	if(where < 0) {
-		if(oob) where = INDEX_OOB;
-		else where += BF_ARRAY_SIZE;
-	} else if(where >= BF_ARRAY_SIZE) {
-		if(oob) where = INDEX_OOB;
-		else where -= BF_ARRAY_SIZE;
-	}
 	return offset;
 }
 
+/* Reads an unsigned big endian number from memory
+ * @param pos The position of the most significant byte
+ * @param n The number of bytes
+ * @return The number (unsigned long)
+ */
+unsigned long get_be(int pos, int n) {
+	unsigned long val = 0;
+	for(int i = 0; i < n; i++)
+		val = (val << 8) | (unsigned char)memory[pos+i];
+	return val;
+}
+
+/* Stores an unsigned big endian number in memory
+ * @param pos The position of the most significant byte
+ * @param n The number of bytes
+ * @param val The number to store
+ */
+void set_be(int pos, int n, unsigned long val) {
+	mark_dirty(pos, pos+n-1);
+	for(int i = n-1; i >= 0; i--, val >>= 8)
+		memory[pos+i] = (char)(val & 0xff);
+}
+
+/* Perform a block read ({) or write (}) for the block I/O extension.
+ * The memory layout at the pointer is:
+ * 		[1 byte channel] [2 byte length] [length bytes of data]
+ * where the channel is BLOCK_STDIO, BLOCK_FILE or BLOCK_SOCKET. Data moves
+ * straight between the tape and the stream or socket. The number of bytes
+ * actually moved replaces the length.
+ * @param op The operation
+ */
+void do_block_io(char op) {
+	int len, done = 0;
+	char *data = &memory[where+3];
+
+	if(where+3 > BF_ARRAY_SIZE) {
+		where = INDEX_OOB;
+		return;
+	}
+	len = (int)get_be(where+1, 2);
+	if(where+3+len > BF_ARRAY_SIZE) {
+		where = INDEX_OOB;
+		return;
+	}
+
+	if(op == '{' && watching) watch_pause(); // The kernel can't fault on the tape
+	switch(memory[where]) {
+		case BLOCK_STDIO:
+			if(op == '{') IO_TIME(IO_STDIO, done = fread(data, 1, len, stdin));
+			else IO_TIME(IO_STDIO, done = fwrite(data, 1, len, stdout));
+			break;
+		case BLOCK_FILE:
+			if(bf_fp == NULL) {
+				where = FILE_ERR;
+				return;
+			}
+			if(op == '{') IO_TIME(IO_FILE, done = fread(data, 1, len, bf_fp));
+			else IO_TIME(IO_FILE, done = fwrite(data, 1, len, bf_fp));
+			break;
+		case BLOCK_SOCKET:
+			if(sock_open) {
+				if(op == '{') done = recv_sock_n(sock_c, data, len);
+				else done = send_sock_n(sock_c, data, len);
+			}
+			break;
+	}
+	if(op == '{' && watching) watch_resume();
+	set_be(where+1, 2, done);
+	if(op == '{' && done > 0) mark_dirty(where+3, where+2+done);
+	STAT_BYTES(op, done);
+}
+
 /* Perform a single SimpleLang++ operation.
  * @param op The operation
  */
 void do_op_bfpp(char op) {
-	int move;
+	int move, at = where;
+	if(rr_mode == RR_REPLAY) {
+		rr_replay(op, at);
+		return;
+	}
 	switch(op) {
 		case '#': // Open file
 			if(file_open && bf_fp != NULL) {
-				fclose(bf_fp);
+				IO_TIME(IO_FILE, fclose(bf_fp));
 				bf_fp = NULL;
 				file_open = 0;
 			} else {
 				move = memory[where];
-				bf_fp = fopen(&memory[where+move], "rb+");
+				IO_TIME(IO_FILE, bf_fp = fopen(&memory[where+move], "rb+"));
+				PROBE(file__open, &memory[where+move], bf_fp != NULL);
 				if(bf_fp == NULL) { // Failure :(
 					memory[where] = 0xff;
 				} else { 			  // Success :)
@@ -364,27 +542,74 @@ void do_op_bfpp(char op) {
 					file_open = 1; // File is now open
 				}
 			}
+			files[cur_file] = bf_fp;
+			break;
+		case '@': // Select file handle
+			if((unsigned char)memory[where] >= MAX_FILES) {
+				memory[where] = 0xff;
+			} else {
+				files[cur_file] = bf_fp;
+				cur_file = (unsigned char)memory[where];
+				bf_fp = files[cur_file];
+				file_open = (bf_fp != NULL);
+				memory[where] = 0;
+			}
+			break;
+		case '$': // Seek in file
+			move = memory[where];
+			if(bf_fp == NULL) {
+				where = FILE_ERR;
+			} else if(where+move < 0 || where+move+4 > BF_ARRAY_SIZE) {
+				where = INDEX_OOB;
+			} else {
+				IO_TIME(IO_FILE, move = fseek(bf_fp, (long)get_be(where+move, 4), SEEK_SET));
+				memory[where] = (move == 0) ? 0 : 0xff;
+			}
+			break;
+		case '{': // Block read
+		case '}': // Block write
+			do_block_io(op);
+			break;
+		case '&': // Send file through socket
+			if(bf_fp == NULL) {
+				where = FILE_ERR;
+			} else if(where+4 > BF_ARRAY_SIZE) {
+				where = INDEX_OOB;
+			} else {
+				move = 0; // Nothing is sent if no socket is open
+				if(sock_open)
+					move = (int)send_file(sock_c, bf_fp, (long)get_be(where, 4));
+				set_be(where, 4, move);
+				STAT_BYTES(op, move);
+			}
 			break;
 		case ';': // Write byte to file
 			if(bf_fp == NULL) {
 				where = FILE_ERR;
 			} else {
-				putc(memory[where], bf_fp);
+				IO_TIME(IO_FILE, putc(memory[where], bf_fp));
+				STAT_BYTES(op, 1);
 			}
 			break;
 		case ':': // Read byte from file
 			if(bf_fp == NULL) {
 				where = FILE_ERR;
 			} else {
-				memory[where] = (char)getc(bf_fp);
+				IO_TIME(IO_FILE, memory[where] = (char)getc(bf_fp));
 				if(memory[where] == EOF) // return 0 at EOF
 					memory[where] = 0;
+				STAT_BYTES(op, 1);
 			}
 			break;
 		case '%':
 			if(sock_open) {
-				close_sock(sock_s);
-				close_sock(sock_c);
+				if(sock_client) {
+					close_client(sock_c); // May be kept for reuse, with --keep-alive
+				} else {
+					close_sock(sock_s);
+					sock_s = INVALID_SOCKET;
+					close_sock(sock_c);
+				}
 				sock_open = 0;
 			} else {
 		   /*
@@ -407,25 +632,45 @@ void do_op_bfpp(char op) {
 				move = memory[where];
 				port = strlen(&memory[where+move]);
 				port = memory[where+move+port+1]*0x100 + memory[where+move+port+2];
-				if(memory[where+move] == '\0') {
+				sock_client = (memory[where+move] != '\0');
+				if(!sock_client) {
 					memory[where] = open_server(&sock_s, &sock_c, port);
 				} else {
 					memory[where] = open_client(&sock_c, &memory[where+move], port);
 				}
+				PROBE(socket__open, &memory[where+move], port, memory[where]);
 				sock_open = 1; // Set socket control variable
 			}
 			break;
 		case '^': // Send 1 byte through socket
 			if(sock_open) {
 				send_sock(sock_c, memory[where]);
+				STAT_BYTES(op, 1);
 			}
 			break;
 		case '!': // Recv 1 byte through socket
 			if(sock_open) {
 				memory[where] = recv_sock(sock_c);
+				STAT_BYTES(op, 1);
 			}
 			break;
 	}
+	if(rr_mode == RR_RECORD) rr_record(op, at);
+}
+
+/* Checks whether a SimpleLang++ operation will write to the tape. A # or %
+ * that closes what it opened, or a ! with no socket, leaves it alone.
+ * @param op The operation
+ * @return 0 if the tape is left alone, 1 otherwise (int)
+ */
+int bfpp_writes(char op) {
+	if(rr_mode == RR_REPLAY) return 1; // The log has the cells
+	switch(op) {
+		case '#': return !(file_open && bf_fp != NULL);
+		case '%': return !sock_open;
+		case '!': return sock_open;
+	}
+	return 1;
 }
 
 /* Parses a command line request and either calls a method or allow 
@@ -442,11 +687,15 @@ int parse_request(char *req) {
 	} else if(strncmp(req, "reset", 5) == 0) {
 		// If the user wants to start over
 		// Reset state variables
-		where = 0;
-		memset(memory, 0, BF_ARRAY_SIZE);
+		reset_tape();
 		return RESET;
 
 	} else if(strncmp(req, "where", 5) == 0) {
+		if(cell_bits != 8) {
+			unsigned long long wide = get_cell(where);
+			printf("Cell %d -> contains '%c' | %llu | 0x%llx\n", where, (char)wide, wide, wide);
+			return 0;
+		}
 		char val = memory[where];
 		printf("Cell %d -> contains '%c' | %d | 0x%x\n", where, val, (unsigned int)val, (unsigned int)val);
 		return 0;
@@ -489,6 +738,14 @@ int parse_request(char *req) {
 				return 0;
 			}
 		}
+		if(cell_bits != 8) {
+			// The low byte of each cell, up to a cell that is 0
+			printf("memory at %d: ", a);
+			for(int k = a; k < BF_ARRAY_SIZE && get_cell(k) != 0; k++)
+				putchar((char)get_cell(k));
+			printf("\n");
+			return 0;
+		}
 		printf("memory at %d: %s\n", a, &memory[a]);
 		return 0;
 
@@ -525,7 +782,8 @@ void disp(char *req) {
 	tmp = strtok(req, " "); // Ignore the first thingy
 	tmp = strtok(NULL, " ");
 	if(tmp == NULL) {
-		printf("%x\n", (unsigned int)memory[where]);
+		if(cell_bits != 8) printf("%llx\n", get_cell(where));
+		else printf("%x\n", (unsigned int)memory[where]);
 		return;
 	}
 
@@ -564,19 +822,26 @@ void disp(char *req) {
 	}
 	
 	// Build the format string
-	sprintf(pstr, "%%%c  ", format);
+	sprintf(pstr, (cell_bits == 8 || format == 'c') ? "%%%c  " : "%%ll%c  ", format);
 	for(int i = 0; i < a; i++) {
-		// Display the data, 5 bytes per line
-		printf(pstr, (unsigned int) memory[pos+i]);
+		// Display the data, 5 cells per line
+		if(cell_bits == 8)
+			printf(pstr, (unsigned int) memory[pos+i]);
+		else if(format == 'c')
+			printf(pstr, (char)get_cell(pos+i));
+		else
+			printf(pstr, get_cell(pos+i));
 		if(i % 5 == 4) printf("\n");
 	}
 	printf("\n");
 }
 
-/* Opens, reads, and runs the SimpleLang(++) code from a source code file
- * @return An exit code, 1 for error, 0 for clean exit
+/* Reads the whole of a SimpleLang(++) source code file
+ * @param fname The name of the file
+ * @return The file contents, null terminated and allocated with malloc,
+ *				or NULL on error (char*)
  */
-int do_file(char *fname) {
+char* read_source(char *fname) {
 	FILE *fp;
 	char *raw;
 	int bytesread;
@@ -585,14 +850,14 @@ int do_file(char *fname) {
 	// This one should probably never happen, but just in case
 	if(fname == NULL) {
 		fprintf(stderr, "Error opening file: could not resolve filename.\n");
-		return 1;
+		return NULL;
 	}
 
 	// Open the file for reading, check that it is, in fact, open
 	fp = fopen(fname, "rb");
 	if(fp == NULL) {
 		fprintf(stderr, "Error: file '%s' could not be opened.\n", fname);
-		return 1;
+		return NULL;
 	}
 
 	// Get the length of the file
@@ -605,7 +870,7 @@ int do_file(char *fname) {
 	if(raw == NULL) {
 		fprintf(stderr, "Error allocating memory.\n");
 		fclose(fp);
-		return 1;
+		return NULL;
 	}
 
 	// Read in the entire file
@@ -619,8 +884,18 @@ int do_file(char *fname) {
 	if(bytesread < filelen) {
 		fprintf(stderr, "Error reading file contents.\n");
 		free(raw);
-		return 1;
+		return NULL;
 	}
+	return raw;
+}
+
+/* Opens, reads, and runs the SimpleLang(++) code from a source code file
+ * @return An exit code, 1 for error, 0 for clean exit
+ */
+int do_file(char *fname) {
+	char *raw = read_source(fname);
+	if(raw == NULL)
+		return 1;
 
 	// Run the code
 	run_code(raw);
@@ -636,11 +911,13 @@ void do_console() {
 	char *raw; // buffer for raw code input
 	// For rolling memory to previous version on an error
 	int roll_where = 0;
-	char rollback[BF_ARRAY_SIZE] = {0};
+	char *rollback = calloc(1, tape_size());
 
 	raw = malloc(BUF_SIZE+1);
-	if(raw == NULL) {
+	if(raw == NULL || rollback == NULL) {
 		fprintf(stderr, "Error allocating memory\n");
+		free(raw);
+		free(rollback);
 		return;
 	}
 
@@ -653,11 +930,12 @@ void do_console() {
 		// Exit cleanly
 		if(res == QUIT) {
 			free(raw);
+			free(rollback);
 			return;
 		} else if(res == RESET) {
 			// Reset everything
 			roll_where = 0;
-			memset(rollback, 0, BF_ARRAY_SIZE);
+			memset(rollback, 0, tape_size());
 			continue;
 		}
 	
@@ -665,50 +943,176 @@ void do_console() {
 		res = run_code(raw);
 		if(res < 0) { // If something goes awol
 			printf("Rolling back SimpleLang memory...\n");
-			memcpy(&memory, rollback, BF_ARRAY_SIZE);
+			memcpy(tape_base(), rollback, tape_size());
 			where = roll_where;
 			continue;
 		}
 		
 		// Save the current data, if something goes wrong next time we can roll back
 		roll_where = where;
-		memcpy(&rollback, memory, BF_ARRAY_SIZE);
+		memcpy(rollback, tape_base(), tape_size());
 	} // End while
 
 	// Clean up
 	free(raw);
+	free(rollback);
 }
 
-/* Runs a given raw code segment
- * @param code the raw code to run
- * @return an error code, or 0 if everything runs fine
+/* Parses raw code and swaps in fused ops, ready for execute()
+ * @param code the raw code to compile
+ * @param buf Where to store the compiled code (created using malloc)
+ * @return The length of the compiled code, or an error code
  */
-int run_code(char *code) {
+int compile(char *code, char **buf) {
 	// Process raw input, get parse length
-	char *buf = NULL;
-	int len = parse(code, &buf);
+	unsigned long long t0 = PROBE_CLOCK();
+	int len = parse(code, buf);
 	if(len < 0) {
-		printf("Error: %s\n", get_error(len));
-		if(buf != NULL)
-			free(buf);
+		PROBE(parse__error, len, parse_errpos);
+		if(len == BAD_BRACKETS || len == LOOP_TOO_DEEP)
+			printf("Error: %s at character %ld\n", get_error(len), parse_errpos);
+		else
+			printf("Error: %s\n", get_error(len));
+		if(*buf != NULL)
+			free(*buf);
+		*buf = NULL;
 		return len;
 	}
+	PROBE(parse__done, len, (long)(PROBE_CLOCK() - t0));
+
+	// Breakpoints are followed through each pass below, then patched in.
+	// Each pass ends its ops at them, and is skipped if that can't be done.
+	int *at = NULL, *map = NULL;
+	char *stops = NULL;
+	if(num_breaks > 0) at = break_positions(code);
+
+	// Swap loop nests for their closed form
+	if(closed_loops) {
+		char *closed = NULL;
+		if(at != NULL) {
+			map = malloc(len * sizeof(int));
+			stops = break_stops(at, len);
+		}
+		int closed_len = (at == NULL || (map != NULL && stops != NULL))
+			? closed_form(*buf, len, &closed, map, stops) : MEMORY_ERR;
+		if(closed_len >= 0) {
+			free(*buf);
+			*buf = closed;
+			len = closed_len;
+			if(at != NULL) move_breaks(at, map);
+		}
+		free(map);
+		free(stops);
+		map = NULL;
+		stops = NULL;
+	}
+
+	// Swap runs of independent loop nests for one op that runs them side by
+	// side. Breakpoints, watchpoints and op counts need one thread.
+	if(par_nests && at == NULL && !watching && !perf_stats && nest_threads() > 1) {
+		char *nests = NULL;
+		int nests_len = parallel_nests(*buf, len, &nests);
+		if(nests_len >= 0) {
+			free(*buf);
+			*buf = nests;
+			len = nests_len;
+		}
+	}
+
+	// Swap common op sequences for fused ops
+	if(superops) {
+		char *fused = NULL;
+		if(at != NULL) {
+			map = malloc(len * sizeof(int));
+			stops = break_stops(at, len);
+		}
+		int fused_len = (at == NULL || (map != NULL && stops != NULL))
+			? fuse(*buf, len, &fused, map, stops) : MEMORY_ERR;
+		if(fused_len >= 0) {
+			free(*buf);
+			*buf = fused;
+			len = fused_len;
+			if(at != NULL) move_breaks(at, map);
+		}
+		free(map);
+		free(stops);
+	}
+
+	if(at != NULL) {
+		patch_breaks(*buf, at);
+		free(at);
+	}
+	return len;
+}
+
+/* Runs compiled code on the current tape, waiting for any threads it forks
+ * @param buf The code, as returned by compile()
+ * @param len The length of buf
+ * @return an error code, or 0 if everything runs fine
+ */
+int execute(char *buf, int len) {
+	int ret = (cell_bits == 8) ? execute_from(buf, len, 0) : execute_wide(buf, len);
+	if(forking) {
+		join_all();
+		if(thread_err) ret = thread_err;
+		thread_err = 0;
+	}
+	if(ret == 0) printf("\n");
+	return ret;
+}
+
+/* Runs compiled code from some position, in the current thread
+ * @param buf The code, as returned by compile()
+ * @param len The length of buf
+ * @param start The position of the first op to run
+ * @return an error code, or 0 if everything runs fine
+ */
+int execute_from(char *buf, int len, int start) {
+	int offset;
 
+	exec_buf = buf;
+	exec_len = len;
 	// Excecute the SimpleLang code
-	for(int i = 0; i < len; i++) {
-		i += do_op(buf[i], &buf[i+1]);
+	for(int i = start; i < len; i++) {
+		offset = do_op(buf[i], &buf[i+1]);
+
+		// Count the op, and whether it entered a loop body
+		if(perf_stats) {
+			stat_ops[(unsigned char)buf[i]]++;
+			if(buf[i] == '[' && offset == sizeof(int)) stat_loops++;
+		}
+		i += offset;
 
 		// Handle errors
 		if(where < 0) {
-			printf("Runtime error at operation %d; %c\n", i-1, buf[i]);
+			if(where == THREAD_HALT) return where; // Already reported
+			PROBE(runtime__error, where, i-1, buf[i]);
+			char text[MAX_SHAPE+1] = { buf[i], '\0' };
+			if(buf[i] >= SUPEROP_BASE && buf[i] < SUPEROP_BASE+NUM_SUPEROPS) superop_text(&buf[i], text);
+			printf("Runtime error at operation %d; %s\n", i-1, text);
 			printf("  : %s\n", get_error(where));
-			free(buf);
+			if(forking) fork_error(where);
 			return where;
 		}
 	} // End for
-	
-	printf("\n");
-	free(buf);
 	return 0;
 }
 
+/* Runs a given raw code segment
+ * @param code the raw code to run
+ * @return an error code, or 0 if everything runs fine
+ */
+int run_code(char *code) {
+	char *buf = NULL;
+	int ret;
+	if(perf_stats) stats_begin();
+
+	ret = compile(code, &buf);
+	if(ret >= 0) {
+		ret = execute(buf, ret);
+		free(buf);
+	}
+
+	if(perf_stats) stats_end();
+	return ret;
+}
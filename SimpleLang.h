@@ -6,6 +6,8 @@
 // Array sizes
 #define BF_ARRAY_SIZE 32768 // 2^15 bytes usable data space
 #define BUF_SIZE      1024  // Read 1024 bytes at a time
+#define MAX_FILES     16    // Handles available to the multiple file extension
+#define MAX_LOOPS     128   // Maximum number of nested loops
 
 // Request parsing options
 #define QUIT  1
@@ -18,6 +20,15 @@
 #define LOOP_TOO_DEEP   -3
 #define FILE_ERR        -4
 #define MEMORY_ERR      -5
+#define REPLAY_ERR      -6
+#define THREAD_ERR      -7
+#define THREAD_HALT     -8
+#define BREAK_ERR       -9
+
+// Block I/O channels
+#define BLOCK_STDIO     0
+#define BLOCK_FILE      1
+#define BLOCK_SOCKET    2
 
 // Help function codes
 #define HELP_HELP       1
@@ -28,26 +39,63 @@
 #define BFPP_HELP       6
 #define INCLUDE_HELP    7
 
+// Thread local storage, for the pointer of each --fork thread
+#ifdef __WIN32__
+	#define THREAD_LOCAL
+#else
+	#define THREAD_LOCAL __thread
+#endif
+
 // variables defined elsewhere (mostly in SimpleLang.c)
 extern int bfpp;
-extern int where;
+extern int multifile;
+extern int blockio;
+extern THREAD_LOCAL int where;
 extern char memory[BF_ARRAY_SIZE];
+extern int dirty_lo, dirty_hi;
 extern int oob;
 
 void cleanup();
+void mark_dirty(int, int);
+void reset_tape();
 const char* get_error(int);
 void show_help(int);
-int shortlen(short*);
-void push(short*, short);
-short pop(short*);
-short peek(short*);
+int bfpp_op(char);
+int ir_size(char);
+int op_size(char*);
 int parse(char*, char**);
 int do_op(char, char*);
+unsigned long get_be(int, int);
+void set_be(int, int, unsigned long);
+void do_block_io(char);
 void do_op_bfpp(char);
+int bfpp_writes(char);
 int parse_request(char*);
 void disp(char*);
+char* read_source(char*);
 int do_file(char*);
 void do_console();
+int compile(char*, char**);
+int execute(char*, int);
+int execute_from(char*, int, int);
 int run_code(char*);
 
+/* Brings the pointer back onto the tape after a move. Either flags an
+ * out-of-bounds error, or wraps around if memory is circular (--no-oob).
+ * Also widens the dirty range, since every write happens near the pointer.
+ * @return 1 if the pointer is out of bounds, 0 otherwise (int)
+ */
+static inline int wrap_where() {
+	if(where < 0) {
+		if(oob) return (where = INDEX_OOB) < 0;
+		where += BF_ARRAY_SIZE;
+	} else if(where >= BF_ARRAY_SIZE) {
+		if(oob) return (where = INDEX_OOB) < 0;
+		where -= BF_ARRAY_SIZE;
+	}
+	if(where < dirty_lo) dirty_lo = where;
+	if(where > dirty_hi) dirty_hi = where;
+	return 0;
+}
+
 #endif // SIMPLELANG_H
@@ -0,0 +1,442 @@
+/* Loopback socket benchmark
+ *
+ * Measures the bf++ socket path (%, ^ and !) by running an echo server
+ * written in bf++ (the loop from examples/server.bpp, sending back each
+ * byte it reads) against clients over loopback, for a range of message
+ * sizes and connection counts. Each connection gets its own server
+ * process, as a bf++ server only takes one client.
+ *
+ * Two clients are run against it:
+ * 		native: a C thread per connection, so the round trip time of each
+ * 		        message can be timed
+ * 		bf++:   a program in the style of examples/client.bpp, run in its
+ * 		        own process, so both ends go through SimpleLangpp.c
+ * Throughput counts the bytes echoed, and syscalls per byte are the sends
+ * and recvs each side made, counted through --io-stats.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef __WIN32__
+	#include <errno.h>
+	#include <pthread.h>
+	#include <signal.h>
+	#include <sys/socket.h>
+	#include <sys/wait.h>
+	#include <netinet/in.h>
+	#include <arpa/inet.h>
+	#include <unistd.h>
+#endif
+
+#include "SimpleLang.h"
+#include "SimpleLangstats.h"
+#include "SimpleLangbench.h"
+
+#ifndef __WIN32__
+
+#define MAX_BENCH_PROG 65536 // Longest generated program
+
+// A message size, as two factors that each fit in a cell
+static const int sizes[][2] = { {1, 1}, {16, 1}, {16, 16}, {64, 64} };
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+static const int conn_counts[] = { 1, BENCH_MAX_CONNS };
+#define NUM_CONN_COUNTS (sizeof(conn_counts) / sizeof(conn_counts[0]))
+
+// A program running in its own process
+struct proc {
+	pid_t pid;
+	int fd; // Read end of the pipe its socket call count comes back on
+};
+
+// One connection of the native client
+struct conn {
+	int port;
+	int size;                 // Bytes per message
+	int messages;             // Messages to send
+	unsigned long long *rtt;  // Round trip time of each message, in ns
+	unsigned long long calls; // Sends and recvs made
+	int ok;                   // Set if every message came back
+};
+
+/*** INTERNAL VARIABLES ***/
+// Ports already used, each run gets a new one as servers don't reuse addresses
+static int port_count = 0;
+/**************************/
+
+/* Gets an unused port. Both bytes stay under 128, as % reads the port
+ * from signed cells.
+ * @return The port (int)
+ */
+static int next_port() {
+	int hi = 0x40 + getpid() % 0x3e;
+	port_count = port_count % 127 + 1;
+	return hi * 0x100 + port_count;
+}
+
+/* Appends a character to a program some number of times
+ * @param p Where to write
+ * @param c The character
+ * @param n The number of times
+ * @return Just after what was written (char*)
+ */
+static char* emit(char *p, char c, int n) {
+	memset(p, c, n);
+	return p + n;
+}
+
+/* Appends a string to a program
+ * @param p Where to write
+ * @param s The string
+ * @return Just after what was written (char*)
+ */
+static char* emits(char *p, const char *s) {
+	int n = strlen(s);
+	memcpy(p, s, n);
+	return p + n;
+}
+
+/* Writes the bf++ echo server. Cells 0-3 hold the % operands, then
+ * cell 4 gets each byte, until a 0 arrives.
+ * @param prog Where to write, MAX_BENCH_PROG bytes
+ * @param port The port to listen on
+ */
+static void server_prog(char *prog, int port) {
+	char *p = prog;
+	p = emits(p, "+>>");
+	p = emit(p, '+', port >> 8);
+	p = emits(p, ">");
+	p = emit(p, '+', port & 0xff);
+	p = emits(p, "<<<%>>>>+[!^]<<<<%");
+	*p = '\0';
+}
+
+/* Writes the bf++ client. Cells 0-12 hold the % operands, then cells 14-17
+ * count messages and bytes. Each message is sent in full, then read back.
+ * A 0 byte tells the server to stop.
+ * @param prog Where to write, MAX_BENCH_PROG bytes
+ * @param port The port to connect to
+ * @param size The message size, as two factors
+ * @param m1 The number of messages is m1 * m2
+ * @param m2 The number of messages is m1 * m2
+ */
+static void client_prog(char *prog, int port, const int *size, int m1, int m2) {
+	const char *host = "localhost";
+	char *p = prog;
+
+	p = emits(p, "+");
+	for(int k = 0; host[k] != '\0'; k++) {
+		p = emits(p, ">");
+		p = emit(p, '+', host[k]);
+	}
+	p = emits(p, ">>");
+	p = emit(p, '+', port >> 8);
+	p = emits(p, ">");
+	p = emit(p, '+', port & 0xff);
+	p = emit(p, '<', strlen(host) + 3);
+	p = emits(p, "%");
+	p = emit(p, '>', 14);
+
+	p = emit(p, '+', m1);
+	p = emits(p, "[>");
+	p = emit(p, '+', m2);
+	p = emits(p, "[>");
+	p = emit(p, '+', size[0]); // Send
+	p = emits(p, "[>");
+	p = emit(p, '+', size[1]);
+	p = emits(p, "[^-]<-]");
+	p = emit(p, '+', size[0]); // Receive
+	p = emits(p, "[>");
+	p = emit(p, '+', size[1]);
+	p = emits(p, "[>!<-]<-]<-]<-]^!%");
+	*p = '\0';
+}
+
+/* Runs a bf++ program in a new process, which sends back the number of
+ * socket calls it made when it is done
+ * @param prog The program
+ * @param pr Where to store the process
+ * @return 0 if everything went well, -1 otherwise (int)
+ */
+static int spawn_prog(char *prog, struct proc *pr) {
+	int fds[2];
+
+	if(pipe(fds) != 0) return -1;
+	fflush(stdout);
+	pr->pid = fork();
+	if(pr->pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if(pr->pid == 0) {
+		close(fds[0]);
+		alarm(BENCH_TIMEOUT);
+		bfpp = 1;
+		io_stats = 1;
+		memset(io_calls, 0, sizeof(io_calls));
+		reset_tape();
+		run_code(prog);
+		if(write(fds[1], &io_calls[IO_SOCK], sizeof(io_calls[IO_SOCK])) < 0) {}
+		_exit(0);
+	}
+	close(fds[1]);
+	pr->fd = fds[0];
+	return 0;
+}
+
+/* Waits for a program started by spawn_prog
+ * @param pr The process
+ * @return The number of socket calls it made, 0 if it failed (unsigned long long)
+ */
+static unsigned long long reap_prog(struct proc *pr) {
+	unsigned long long calls = 0;
+	if(read(pr->fd, &calls, sizeof(calls)) != sizeof(calls)) calls = 0;
+	close(pr->fd);
+	while(waitpid(pr->pid, NULL, 0) < 0 && errno == EINTR) {}
+	return calls;
+}
+
+/* Waits until a server is listening on a port, so clients don't race it.
+ * Probing with a connection would take the server's only accept, so on
+ * Linux the kernel's socket table is read instead.
+ * @param port The port
+ * @return 0 if the server is listening, -1 if it never showed up (int)
+ */
+static int wait_listening(int port) {
+#ifdef __linux__
+	char line[256];
+	unsigned int lport, state;
+	FILE *fp;
+
+	for(int tries = 0; tries < 5000; tries++) {
+		fp = fopen("/proc/net/tcp", "r");
+		if(fp == NULL) break;
+		while(fgets(line, sizeof(line), fp) != NULL) {
+			if(sscanf(line, " %*d: %*x:%x %*x:%*x %x", &lport, &state) == 2
+					&& lport == (unsigned int)port && state == 0x0A) {
+				fclose(fp);
+				return 0;
+			}
+		}
+		fclose(fp);
+		usleep(1000);
+	}
+	return -1;
+#else
+	usleep(200000);
+	return 0;
+#endif
+}
+
+/* Starts an echo server for each connection
+ * @param n The number of connections
+ * @param ports Where to store the port of each server
+ * @param servers Where to store the server processes
+ * @return The number of servers started (int)
+ */
+static int start_servers(int n, int *ports, struct proc *servers) {
+	char *prog = malloc(MAX_BENCH_PROG);
+	int k;
+
+	if(prog == NULL) return 0;
+	for(k = 0; k < n; k++) {
+		ports[k] = next_port();
+		server_prog(prog, ports[k]);
+		if(spawn_prog(prog, &servers[k]) != 0) break;
+		if(wait_listening(ports[k]) != 0) {
+			kill(servers[k].pid, SIGKILL);
+			reap_prog(&servers[k]);
+			break;
+		}
+	}
+	free(prog);
+	return k;
+}
+
+/* Runs one connection of the native client
+ * @param arg The connection (struct conn*)
+ */
+static void* native_client(void *arg) {
+	struct conn *c = arg;
+	struct sockaddr_in addr;
+	char *msg = malloc(c->size), *back = malloc(c->size);
+	unsigned long long t0;
+	int s, got, ret;
+
+	c->ok = 0;
+	c->calls = 0;
+	if(msg == NULL || back == NULL || (s = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		free(msg);
+		free(back);
+		return NULL;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(c->port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if(connect(s, (struct sockaddr*)&addr, sizeof(addr)) != 0) goto done;
+
+	memset(msg, 'x', c->size);
+	for(int m = 0; m < c->messages; m++) {
+		t0 = now_ns();
+		for(got = 0; got < c->size; got += ret) {
+			c->calls++;
+			if((ret = send(s, msg+got, c->size-got, 0)) <= 0) goto done;
+		}
+		for(got = 0; got < c->size; got += ret) {
+			c->calls++;
+			if((ret = recv(s, back+got, c->size-got, 0)) <= 0) goto done;
+		}
+		c->rtt[m] = now_ns() - t0;
+	}
+	// Stop the server, and wait for it to get the message
+	msg[0] = 0;
+	if(send(s, msg, 1, 0) == 1 && recv(s, back, 1, 0) == 1) c->ok = 1;
+
+done:
+	close(s);
+	free(msg);
+	free(back);
+	return NULL;
+}
+
+/* Compares two round trip times, for qsort
+ */
+static int cmp_rtt(const void *a, const void *b) {
+	unsigned long long x = *(const unsigned long long*)a, y = *(const unsigned long long*)b;
+	return (x > y) - (x < y);
+}
+
+/* Runs the native client against bf++ servers, and prints one row
+ * @param size The message size, as two factors
+ * @param n The number of connections
+ * @param messages Messages per connection
+ * @return 0 if everything went well, -1 otherwise (int)
+ */
+static int bench_native(const int *size, int n, int messages) {
+	int bytes = size[0] * size[1], ok = 1, ports[BENCH_MAX_CONNS], started;
+	struct proc servers[BENCH_MAX_CONNS];
+	struct conn conns[BENCH_MAX_CONNS];
+	pthread_t threads[BENCH_MAX_CONNS];
+	unsigned long long *rtt, t0, wall, srv_calls = 0, cli_calls = 0;
+	long total = (long)n * messages;
+
+	if((rtt = calloc(total, sizeof(*rtt))) == NULL) return -1;
+	if((started = start_servers(n, ports, servers)) < n) ok = 0;
+
+	t0 = now_ns();
+	for(int k = 0; k < started; k++) {
+		conns[k].port = ports[k];
+		conns[k].size = bytes;
+		conns[k].messages = messages;
+		conns[k].rtt = &rtt[(long)k * messages];
+		pthread_create(&threads[k], NULL, native_client, &conns[k]);
+	}
+	for(int k = 0; k < started; k++) {
+		pthread_join(threads[k], NULL);
+		ok &= conns[k].ok;
+		cli_calls += conns[k].calls;
+	}
+	wall = now_ns() - t0;
+	for(int k = 0; k < started; k++)
+		srv_calls += reap_prog(&servers[k]);
+
+	if(!ok) {
+		printf("%7d %5d   failed\n", bytes, n);
+	} else {
+		qsort(rtt, total, sizeof(*rtt), cmp_rtt);
+		printf("%7d %5d %9.1f %9.1f %9.1f %9.1f %11.2f %11.2f\n", bytes, n,
+				(double)total * bytes * 1e6 / wall,
+				rtt[total*50/100] / 1e3, rtt[total*90/100] / 1e3, rtt[total*99/100] / 1e3,
+				(double)cli_calls / ((double)total * bytes),
+				(double)srv_calls / ((double)total * bytes));
+	}
+	free(rtt);
+	return ok ? 0 : -1;
+}
+
+/* Runs bf++ clients against bf++ servers, and prints one row
+ * @param size The message size, as two factors
+ * @param n The number of connections
+ * @param m1 The number of messages is m1 * m2
+ * @param m2 The number of messages is m1 * m2
+ * @return 0 if everything went well, -1 otherwise (int)
+ */
+static int bench_bfpp(const int *size, int n, int m1, int m2) {
+	int bytes = size[0] * size[1], ok = 1, ports[BENCH_MAX_CONNS], started, k;
+	struct proc servers[BENCH_MAX_CONNS], clients[BENCH_MAX_CONNS];
+	unsigned long long t0, wall, srv_calls = 0, cli_calls = 0, calls;
+	double total = (double)n * m1 * m2 * bytes;
+	char *prog = malloc(MAX_BENCH_PROG);
+
+	if(prog == NULL) return -1;
+	if((started = start_servers(n, ports, servers)) < n) ok = 0;
+
+	t0 = now_ns();
+	for(k = 0; k < started; k++) {
+		client_prog(prog, ports[k], size, m1, m2);
+		if(spawn_prog(prog, &clients[k]) != 0) break;
+	}
+	for(int j = 0; j < k; j++) {
+		cli_calls += (calls = reap_prog(&clients[j]));
+		if(calls == 0) ok = 0;
+	}
+	wall = now_ns() - t0;
+	for(int j = 0; j < started; j++) {
+		if(j >= k) kill(servers[j].pid, SIGKILL); // Never got a client
+		srv_calls += reap_prog(&servers[j]);
+	}
+	if(k < started) ok = 0;
+
+	if(!ok) {
+		printf("%7d %5d   failed\n", bytes, n);
+	} else {
+		printf("%7d %5d %9.1f %11.2f %11.2f\n", bytes, n, total * 1e6 / wall,
+				cli_calls / total, srv_calls / total);
+	}
+	free(prog);
+	return ok ? 0 : -1;
+}
+
+/* Runs the loopback benchmark and prints the results to stdout
+ * @param messages Messages sent on each connection, rounded up so bf++
+ * 		can count them
+ * @return 0 if everything went well, 1 otherwise (int)
+ */
+int bench_sockets(int messages) {
+	int m2, m1, ret = 0;
+
+	if(messages <= 0) messages = BENCH_MESSAGES;
+	m2 = (messages < 255) ? messages : 255;
+	m1 = (messages + m2 - 1) / m2;
+	if(m1 > 255) m1 = 255;
+	messages = m1 * m2;
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("Native client, bf++ echo server, %d messages per connection\n", messages);
+	printf("%7s %5s %9s %9s %9s %9s %11s %11s\n", "bytes", "conns", "KB/s",
+			"p50 us", "p90 us", "p99 us", "cli call/B", "srv call/B");
+	for(int s = 0; s < NUM_SIZES; s++) {
+		for(int n = 0; n < NUM_CONN_COUNTS; n++)
+			ret |= bench_native(sizes[s], conn_counts[n], messages);
+	}
+
+	printf("\nbf++ client, bf++ echo server, %d messages per connection\n", messages);
+	printf("%7s %5s %9s %11s %11s\n", "bytes", "conns", "KB/s", "cli call/B", "srv call/B");
+	for(int s = 0; s < NUM_SIZES; s++) {
+		for(int n = 0; n < NUM_CONN_COUNTS; n++)
+			ret |= bench_bfpp(sizes[s], conn_counts[n], m1, m2);
+	}
+	return ret ? 1 : 0;
+}
+
+#else
+
+int bench_sockets(int messages) {
+	fprintf(stderr, "Error: the socket benchmark needs fork and pthreads.\n");
+	return 1;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef SIMPLELANGBENCH_H
+#define SIMPLELANGBENCH_H
+
+#define BENCH_MESSAGES  50   // Default messages sent on each connection
+#define BENCH_MAX_CONNS 4    // Most connections run at once
+#define BENCH_TIMEOUT   120  // Seconds before a stuck benchmark process is killed
+
+int bench_sockets(int);
+
+#endif // SIMPLELANGBENCH_H
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "SimpleLang.h"
+#include "SimpleLangstats.h"
+#include "SimpleLangsuper.h"
+#include "SimpleLangloop.h"
+#include "SimpleLangnest.h"
+#include "SimpleLangcell.h"
+#include "SimpleLangprobe.h"
+#include "SimpleLangrr.h"
+
+/*** EXTERNAL VARIABLES ***/
+// Width of a cell in bits, anything but 8 runs on the wide tape
+int cell_bits = CELL_BITS;
+/**************************/
+
+/*** INTERNAL VARIABLES ***/
+// The tape for wide cells, BF_ARRAY_SIZE cells of cell_bits each
+static void *wide_tape = NULL;
+// The engine for the current width
+static int (*engine)(char*, int) = NULL;
+/**************************/
+
+/* Gets a cell, at any width
+ * @param k The cell
+ * @return The value of the cell (unsigned long long)
+ */
+unsigned long long get_cell(int k) {
+	switch(cell_bits) {
+		case 16: return ((uint16_t*)wide_tape)[k];
+		case 32: return ((uint32_t*)wide_tape)[k];
+		case 64: return ((uint64_t*)wide_tape)[k];
+	}
+	return (unsigned char)memory[k];
+}
+
+/* Sets a cell on the wide tape
+ * @param k The cell
+ * @param val The new value, truncated to the cell width
+ */
+static void set_cell(int k, unsigned long long val) {
+	switch(cell_bits) {
+		case 16: ((uint16_t*)wide_tape)[k] = (uint16_t)val; break;
+		case 32: ((uint32_t*)wide_tape)[k] = (uint32_t)val; break;
+		case 64: ((uint64_t*)wide_tape)[k] = (uint64_t)val; break;
+	}
+}
+
+/* Widens a byte written by an op. 0xFF is -1 (EOF, or a failed op), so it
+ * stays -1 and 8 bit tests like ,+[ still work. Other bytes are zero extended.
+ * @param b The byte
+ * @return The cell value (unsigned long long)
+ */
+static unsigned long long widen(char b) {
+	return ((unsigned char)b == 0xFF) ? ~0ULL : (unsigned char)b;
+}
+
+/* Copies cells to the byte tape, as their low bytes
+ * @param lo The first cell
+ * @param hi One past the last cell
+ */
+static void narrow_cells(int lo, int hi) {
+	if(lo < 0) lo = 0;
+	if(hi > BF_ARRAY_SIZE) hi = BF_ARRAY_SIZE;
+	for(int k = lo; k < hi; k++)
+		memory[k] = (char)get_cell(k);
+}
+
+/* Copies a 0 terminated string to the byte tape
+ * @param k The first cell
+ * @return The cell after the 0 (int)
+ */
+static int narrow_string(int k) {
+	while(k >= 0 && k < BF_ARRAY_SIZE) {
+		memory[k] = (char)get_cell(k);
+		if(memory[k++] == '\0') break;
+	}
+	return k;
+}
+
+/* Runs an I/O op on the wide tape, through the byte tape that the ops
+ * work on. Only the cells the op reads are copied across, and only the
+ * cells it wrote come back.
+ * @param op The op
+ * @param next The operands after the op
+ * @return The offset to apply to the code pointer
+ */
+static int wide_io(char op, char *next) {
+	int offset, at = where, first, len;
+
+	switch(op) {
+		case '.': case ';': case '^': // Send the low byte
+			memory[where] = (char)get_cell(where);
+			return do_op(op, next);
+	}
+	if(!bfpp_writes(op)) return do_op(op, next);
+
+	// The op reads a layout near the pointer
+	memory[at] = (char)get_cell(at);
+	switch(op) {
+		case '#': // File name
+			narrow_string(at + memory[at]);
+			break;
+		case '%': // Host, then the port
+			first = narrow_string(at + memory[at]);
+			narrow_cells(first, first+2);
+			break;
+		case '$': // Position to seek to
+			narrow_cells(at + memory[at], at + memory[at] + 4);
+			break;
+		case '&': // Bytes to send
+			narrow_cells(at, at+4);
+			break;
+		case '{': // Length
+		case '}': // Length, then the data
+			narrow_cells(at+1, at+3);
+			if(op == '}' && at+3 <= BF_ARRAY_SIZE)
+				narrow_cells(at+3, at+3 + (int)get_be(at+1, 2));
+			break;
+	}
+	offset = do_op(op, next);
+	if(where != at) return offset; // The op failed, nothing was written
+
+	first = rr_span(op, at, &len); // The same cells a recording keeps
+	for(int k = first; k < first+len && k < BF_ARRAY_SIZE; k++)
+		set_cell(k, widen(memory[k]));
+	return offset;
+}
+
+// One engine per width
+#define CELL   uint16_t
+#define ENGINE execute_16
+#include "SimpleLangengine.h"
+#undef CELL
+#undef ENGINE
+
+#define CELL   uint32_t
+#define ENGINE execute_32
+#include "SimpleLangengine.h"
+#undef CELL
+#undef ENGINE
+
+#define CELL   uint64_t
+#define ENGINE execute_64
+#include "SimpleLangengine.h"
+#undef CELL
+#undef ENGINE
+
+/* Sets the cell width, making the wide tape if it is needed
+ * @param bits The width, 8, 16, 32 or 64
+ * @return 0 if everything went well, 1 otherwise (int)
+ */
+int cell_begin(int bits) {
+	switch(bits) {
+		case 8:  cell_bits = bits; return 0;
+		case 16: engine = execute_16; break;
+		case 32: engine = execute_32; break;
+		case 64: engine = execute_64; break;
+		default:
+			fprintf(stderr, "Error: cells may be 8, 16, 32 or 64 bits, not %d.\n", bits);
+			return 1;
+	}
+	free(wide_tape);
+	wide_tape = calloc(BF_ARRAY_SIZE, bits / 8);
+	if(wide_tape == NULL) {
+		fprintf(stderr, "Error: %s\n", get_error(MEMORY_ERR));
+		return 1;
+	}
+	cell_bits = bits;
+	superops = 0;
+	closed_loops = 0;
+	par_nests = 0;
+	return 0;
+}
+
+/* Runs parsed code on the wide tape
+ * @param buf The code
+ * @param len The length of buf
+ * @return an error code, or 0 if everything runs fine
+ */
+int execute_wide(char *buf, int len) {
+	return engine(buf, len);
+}
+
+/* Gets the tape in use, for saving and restoring it
+ * @return The first cell (void*)
+ */
+void* tape_base() {
+	return (cell_bits == 8) ? (void*)memory : wide_tape;
+}
+
+/* Gets the size of the tape in use
+ * @return The size in bytes (long)
+ */
+long tape_size() {
+	return (long)BF_ARRAY_SIZE * (cell_bits / 8);
+}
@@ -0,0 +1,28 @@
+#ifndef SIMPLELANGCELL_H
+#define SIMPLELANGCELL_H
+
+/* Wide cells (--cell-bits 16, 32 or 64). Cells wrap at their own width
+ * (0xFFFF + 1 == 0 for 16 bits), on a separate tape, and each width has its
+ * own copy of the engine, built from SimpleLangengine.h, so the hot loop
+ * never checks the width.
+ *
+ * I/O still moves bytes. Output ops (. ; ^) send the low byte of the cell,
+ * and input ops (, : !) store the byte zero extended, except 0xFF, which is
+ * EOF or a -1 result at 8 bits and stays -1. Ops that read a layout from the
+ * tape (# % @ $ { } &) see the low byte of each cell, and the cells they
+ * write are widened the same way. Fused ops and closed form loops assume
+ * 1 byte cells, so wide cells turn them off.
+ */
+
+#define CELL_BITS 8 // Default cell width
+
+// variables defined in SimpleLangcell.c
+extern int cell_bits;
+
+int cell_begin(int);
+int execute_wide(char*, int);
+unsigned long long get_cell(int);
+void* tape_base();
+long tape_size();
+
+#endif // SIMPLELANGCELL_H
@@ -0,0 +1,351 @@
+/* Interpreter daemon
+ *
+ * A long lived server that runs program-plus-input jobs sent over a Unix
+ * domain socket, so short jobs don't pay for process startup and parsing.
+ * A pool of worker processes is forked up front, each with its own tape
+ * that is already zeroed and paged in. Workers keep the programs they have
+ * compiled, and after each job only clear the part of the tape it used.
+ *
+ * A job on the wire is:
+ * 		[4 byte big endian program length] [program] [input until EOF]
+ * and the daemon sends back the program's output, then closes the connection.
+ * A job that runs longer than JOB_TIMEOUT takes its worker down with it, and
+ * a fresh worker is forked in its place.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef __WIN32__
+	#include <errno.h>
+	#include <poll.h>
+	#include <signal.h>
+	#include <stdio_ext.h> //__fpurge
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <sys/wait.h>
+	#include <unistd.h>
+#endif
+#ifdef __linux__
+	#include <sys/prctl.h>
+#endif
+
+#include "SimpleLang.h"
+#include "SimpleLangd.h"
+
+#ifndef __WIN32__
+
+// A compiled program kept by a worker
+struct cached {
+	unsigned long hash; // Hash of the source
+	char *src;          // The source, NULL if the slot is empty
+	long srclen;        // The length of src
+	char *buf;          // The compiled code
+	int len;            // The length of buf
+};
+
+/*** INTERNAL VARIABLES ***/
+// This worker's compiled programs, indexed by hash
+static struct cached cache[CACHE_SIZE];
+/**************************/
+
+/* Hashes a program's source (FNV-1a)
+ * @param src The source
+ * @param len The length of src
+ * @return The hash (unsigned long)
+ */
+static unsigned long hash_source(char *src, long len) {
+	unsigned long h = 2166136261UL;
+	for(long i = 0; i < len; i++) {
+		h ^= (unsigned char)src[i];
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+/* Reads exactly n bytes from a file descriptor
+ * @param fd The file descriptor
+ * @param data Where to store the data
+ * @param n The number of bytes
+ * @return 0 if everything went well, -1 otherwise (int)
+ */
+static int read_full(int fd, char *data, long n) {
+	long ret;
+	while(n > 0) {
+		ret = read(fd, data, n);
+		if(ret < 0 && errno == EINTR) continue;
+		if(ret <= 0) return -1;
+		data += ret;
+		n -= ret;
+	}
+	return 0;
+}
+
+/* Writes exactly n bytes to a file descriptor
+ * @param fd The file descriptor
+ * @param data The data
+ * @param n The number of bytes
+ * @return 0 if everything went well, -1 otherwise (int)
+ */
+static int write_full(int fd, char *data, long n) {
+	long ret;
+	while(n > 0) {
+		ret = write(fd, data, n);
+		if(ret < 0 && errno == EINTR) continue;
+		if(ret <= 0) return -1;
+		data += ret;
+		n -= ret;
+	}
+	return 0;
+}
+
+/* Gets the compiled code for a program, compiling and caching it if needed
+ * @param src The source, null terminated
+ * @param srclen The length of src
+ * @param len Where to store the length of the compiled code
+ * @return The compiled code, owned by the cache, or NULL on error (char*)
+ */
+static char* lookup(char *src, long srclen, int *len) {
+	unsigned long h = hash_source(src, srclen);
+	struct cached *c = &cache[h % CACHE_SIZE];
+	char *buf = NULL, *copy;
+	int n;
+
+	if(c->src != NULL && c->hash == h && c->srclen == srclen && memcmp(c->src, src, srclen) == 0) {
+		*len = c->len;
+		return c->buf;
+	}
+
+	n = compile(src, &buf);
+	if(n < 0) return NULL;
+	copy = malloc(srclen+1);
+	if(copy == NULL) {
+		free(buf);
+		return NULL;
+	}
+	memcpy(copy, src, srclen+1);
+
+	// Replace whatever was in the slot
+	free(c->src);
+	free(c->buf);
+	c->hash = h;
+	c->src = copy;
+	c->srclen = srclen;
+	c->buf = buf;
+	c->len = n;
+	*len = n;
+	return buf;
+}
+
+/* Runs one job. The connection stands in for stdin and stdout while the
+ * program runs, so , and . work as they do from the command line.
+ * @param conn The job's connection
+ */
+static void run_job(int conn) {
+	unsigned char hdr[4];
+	long srclen;
+	int len, saved_in, saved_out;
+	char *src, *buf;
+
+	if(read_full(conn, (char*)hdr, 4) != 0) return;
+	srclen = ((long)hdr[0] << 24) | (hdr[1] << 16) | (hdr[2] << 8) | hdr[3];
+	if(srclen > MAX_JOB_SOURCE) return;
+	src = malloc(srclen+1);
+	if(src == NULL) return;
+	if(read_full(conn, src, srclen) != 0) {
+		free(src);
+		return;
+	}
+	src[srclen] = '\0';
+
+	// Swap the connection in for stdin and stdout
+	fflush(stdout);
+	saved_in = dup(0);
+	saved_out = dup(1);
+	dup2(conn, 0);
+	dup2(conn, 1);
+	__fpurge(stdin);
+	clearerr(stdin);
+
+	buf = lookup(src, srclen, &len);
+	if(buf != NULL) execute(buf, len);
+
+	// Put everything back for the next job
+	fflush(stdout);
+	dup2(saved_in, 0);
+	dup2(saved_out, 1);
+	close(saved_in);
+	close(saved_out);
+	__fpurge(stdin);
+	clearerr(stdin);
+	if(bfpp) cleanup();
+	reset_tape();
+	free(src);
+}
+
+/* A worker's main loop, takes jobs off the listening socket forever
+ * @param lsock The listening socket
+ */
+static void worker(int lsock) {
+	int conn;
+
+#ifdef __linux__
+	prctl(PR_SET_PDEATHSIG, SIGTERM); // Go away with the daemon
+#endif
+	// Fault the tape in now, rather than during the first job
+	memset(memory, 0, BF_ARRAY_SIZE);
+
+	while( 1 ) {
+		conn = accept(lsock, NULL, NULL);
+		if(conn < 0) continue;
+		alarm(JOB_TIMEOUT); // SIGALRM ends the worker, the daemon replaces it
+		run_job(conn);
+		alarm(0);
+		close(conn);
+	}
+}
+
+/* Forks a worker
+ * @param lsock The listening socket
+ * @return The worker's process id, or -1 on failure (pid_t)
+ */
+static pid_t spawn_worker(int lsock) {
+	pid_t pid = fork();
+	if(pid == 0) {
+		worker(lsock);
+		_exit(0);
+	}
+	return pid;
+}
+
+/* Starts the daemon and runs until killed. Workers that die are replaced.
+ * @param path The path of the Unix domain socket to listen on
+ * @param workers The number of worker processes
+ * @return An exit code, 1 for error (int)
+ */
+int run_daemon(char *path, int workers) {
+	struct sockaddr_un addr;
+	int lsock, status;
+	pid_t pid;
+
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Error: socket path '%s' is too long.\n", path);
+		return 1;
+	}
+	if(workers < 1) workers = DAEMON_WORKERS;
+	signal(SIGPIPE, SIG_IGN); // A client hanging up only ends its own job
+
+	lsock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(lsock < 0) {
+		perror("socket");
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if(bind(lsock, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(lsock, 64) != 0) {
+		perror(path);
+		close(lsock);
+		return 1;
+	}
+
+	for(int i = 0; i < workers; i++) {
+		if(spawn_worker(lsock) < 0) perror("fork");
+	}
+	fprintf(stderr, "Listening on %s with %d workers\n", path, workers);
+
+	while( 1 ) {
+		pid = wait(&status);
+		if(pid < 0) {
+			if(errno == EINTR) continue;
+			break;
+		}
+		spawn_worker(lsock);
+	}
+	close(lsock);
+	return 1;
+}
+
+/* Sends a program to a daemon as a job, with stdin as its input, and
+ * copies the output to stdout
+ * @param path The path of the daemon's Unix domain socket
+ * @param fname The program's source file
+ * @return An exit code, 1 for error, 0 for clean exit
+ */
+int submit_job(char *path, char *fname) {
+	struct sockaddr_un addr;
+	struct pollfd fds[2];
+	unsigned char hdr[4];
+	char data[BUF_SIZE];
+	char *src;
+	long srclen, n;
+	int sock;
+
+	src = read_source(fname);
+	if(src == NULL) return 1;
+	srclen = strlen(src);
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+	if(sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		perror(path);
+		free(src);
+		return 1;
+	}
+
+	hdr[0] = srclen >> 24;
+	hdr[1] = srclen >> 16;
+	hdr[2] = srclen >> 8;
+	hdr[3] = srclen;
+	if(write_full(sock, (char*)hdr, 4) != 0 || write_full(sock, src, srclen) != 0) {
+		fprintf(stderr, "Error sending job.\n");
+		free(src);
+		close(sock);
+		return 1;
+	}
+	free(src);
+
+	// Feed stdin in and copy output out until the daemon hangs up
+	fds[0].fd = 0;
+	fds[0].events = POLLIN;
+	fds[1].fd = sock;
+	fds[1].events = POLLIN;
+	while( 1 ) {
+		if(poll(fds, 2, -1) < 0) {
+			if(errno == EINTR) continue;
+			break;
+		}
+		if(fds[0].revents) {
+			n = read(0, data, BUF_SIZE);
+			if(n <= 0 || write_full(sock, data, n) != 0) {
+				shutdown(sock, SHUT_WR); // EOF for the program's input
+				fds[0].fd = -1;
+			}
+		}
+		if(fds[1].revents) {
+			n = read(sock, data, BUF_SIZE);
+			if(n <= 0) break;
+			write_full(1, data, n);
+		}
+	}
+	close(sock);
+	return 0;
+}
+
+#else
+
+int run_daemon(char *path, int workers) {
+	fprintf(stderr, "Error: the daemon needs Unix domain sockets.\n");
+	return 1;
+}
+
+int submit_job(char *path, char *fname) {
+	fprintf(stderr, "Error: the daemon needs Unix domain sockets.\n");
+	return 1;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef SIMPLELANGD_H
+#define SIMPLELANGD_H
+
+#define DAEMON_WORKERS 4         // Default number of pre-forked workers
+#define CACHE_SIZE     64        // Compiled programs kept by each worker
+#define MAX_JOB_SOURCE (4L << 20) // Largest program a job may send, 4 MB
+#define JOB_TIMEOUT    60        // Seconds before a stuck job's worker is killed and replaced
+
+int run_daemon(char*, int);
+int submit_job(char*, char*);
+
+#endif // SIMPLELANGD_H
@@ -0,0 +1,296 @@
+#define _GNU_SOURCE // REG_EFL
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__i386__))
+	#define HAVE_WATCH
+	#include <signal.h>
+	#include <ucontext.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+#endif
+
+#include "SimpleLang.h"
+#include "SimpleLangdebug.h"
+
+#define TRAP_FLAG 0x100 // x86 EFLAGS single step bit
+
+// A breakpoint patched into compiled code
+struct patch {
+	char *at;  // The patched op
+	char op;   // The op it replaced
+	long pos;  // The source position it was set at
+};
+
+/*** EXTERNAL VARIABLES ***/
+// Number of breakpoints set
+int num_breaks = 0;
+// Set while watchpoints are armed
+int watching = 0;
+/**************************/
+
+/*** INTERNAL VARIABLES ***/
+// Source positions of the breakpoints
+static long breaks[MAX_BREAKS];
+// Breakpoints patched into the code being run
+static struct patch patches[MAX_BREAKS];
+static int num_patches = 0;
+// Watched cells, and the value each had when last checked
+static int watches[MAX_WATCHES];
+static char watch_val[MAX_WATCHES];
+static int num_watches = 0;
+/**************************/
+
+/* Adds a breakpoint
+ * @param pos The source position, counted in characters from 0
+ * @return 0 if everything went well, 1 otherwise (int)
+ */
+int add_break(long pos) {
+	if(num_breaks == MAX_BREAKS || pos < 0) {
+		fprintf(stderr, "Error: breakpoint at %ld could not be set.\n", pos);
+		return 1;
+	}
+	breaks[num_breaks++] = pos;
+	return 0;
+}
+
+/* Finds where each breakpoint lands in parsed code, the first op at or
+ * after its source position
+ * @param code The source
+ * @return The parsed position of each breakpoint, -1 for none, created using malloc (int*)
+ */
+int* break_positions(char *code) {
+	int *at = malloc(MAX_BREAKS * sizeof(int));
+	long len = strlen(code);
+	int off;
+
+	if(at == NULL) return NULL;
+	for(int k = 0; k < num_breaks; k++) {
+		at[k] = -1;
+		off = 0;
+		for(long i = 0; i < len; i++) {
+			if(i >= breaks[k] && ir_size(code[i])) {
+				at[k] = off;
+				break;
+			}
+			off += ir_size(code[i]);
+		}
+	}
+	return at;
+}
+
+/* Follows breakpoints through a pass that rewrites the code
+ * @param at The position of each breakpoint, updated in place
+ * @param map The pass's map from old positions to new ones, NULL drops them all
+ */
+void move_breaks(int *at, int *map) {
+	for(int k = 0; k < num_breaks; k++) {
+		if(at[k] >= 0) at[k] = (map != NULL) ? map[at[k]] : -1;
+	}
+}
+
+/* Marks the breakpoints in code about to go through a pass that rewrites
+ * it, so the pass doesn't run an op across one
+ * @param at The position of each breakpoint
+ * @param len The length of the code
+ * @return A flag for each position of the code, created using malloc (char*)
+ */
+char* break_stops(int *at, int len) {
+	char *stops = calloc(len+1, 1);
+	if(stops == NULL) return NULL;
+	for(int k = 0; k < num_breaks; k++) {
+		if(at[k] >= 0 && at[k] < len) stops[at[k]] = 1;
+	}
+	return stops;
+}
+
+/* Patches the breakpoints into compiled code
+ * @param buf The code
+ * @param at The position of each breakpoint in buf
+ */
+void patch_breaks(char *buf, int *at) {
+	num_patches = 0;
+	for(int k = 0; k < num_breaks; k++) {
+		if(at[k] < 0 || buf[at[k]] == OP_BREAK) continue;
+		patches[num_patches].at = &buf[at[k]];
+		patches[num_patches].op = buf[at[k]];
+		patches[num_patches].pos = breaks[k];
+		num_patches++;
+		buf[at[k]] = OP_BREAK;
+	}
+}
+
+/* Lets the user look at the tape from a breakpoint, using the console's
+ * where, print and disp commands. Reads from the terminal, as stdin
+ * belongs to the program.
+ */
+static void break_prompt() {
+	char line[BUF_SIZE];
+	FILE *tty = fopen("/dev/tty", "r");
+	int res;
+
+	if(tty == NULL) return; // Nobody to ask, just keep going
+	while( 1 ) {
+		fprintf(stderr, "(break) ");
+		if(fgets(line, BUF_SIZE, tty) == NULL) break;
+		if(line[0] == '\n' || line[0] == 'c') break; // continue
+		res = parse_request(line);
+		if(res == QUIT) {
+			fclose(tty);
+			cleanup();
+			exit(0);
+		} else if(res == CODE) {
+			fprintf(stderr, "Commands: continue, where, print [n], disp, reset, quit\n");
+		}
+		fflush(stdout);
+	}
+	fclose(tty);
+}
+
+/* Runs an OP_BREAK: reports the breakpoint, waits for the user, then runs
+ * the op that was patched over. An OP_BREAK with no saved op is an error.
+ * @param next The operands after the op
+ * @return The offset to apply to the code pointer
+ */
+int run_break(char *next) {
+	struct patch *p = NULL;
+	for(int k = 0; k < num_patches; k++) {
+		if(patches[k].at == next-1) p = &patches[k];
+	}
+	if(p == NULL) {
+		where = BREAK_ERR;
+		return 0;
+	}
+
+	fflush(stdout);
+	fprintf(stderr, "Breakpoint at character %ld, pointer at cell %d (%d)\n",
+			p->pos, where, (unsigned char)memory[where]);
+	break_prompt();
+	return do_op(p->op, next);
+}
+
+#ifdef HAVE_WATCH
+/* Writes a number to stderr, printf is not safe in a signal handler
+ * @param val The number
+ */
+static void put_num(long val) {
+	char digits[24];
+	int n = sizeof(digits);
+	int neg = val < 0;
+	if(neg) val = -val;
+	do {
+		digits[--n] = '0' + val % 10;
+		val /= 10;
+	} while(val > 0);
+	if(neg) digits[--n] = '-';
+	if(write(2, &digits[n], sizeof(digits)-n) < 0) {}
+}
+
+/* Writes a string to stderr from a signal handler
+ * @param str The string
+ */
+static void put_str(const char *str) {
+	if(write(2, str, strlen(str)) < 0) {}
+}
+
+/* Sets the protection of every watched page
+ * @param prot PROT_READ to arm, PROT_READ|PROT_WRITE to disarm
+ */
+static void protect(int prot) {
+	for(int k = 0; k < num_watches; k++)
+		mprotect(&memory[watches[k] & ~(TAPE_PAGE-1)], TAPE_PAGE, prot);
+}
+
+/* Reports every watched cell that changed since the last check
+ */
+static void check_watches() {
+	for(int k = 0; k < num_watches; k++) {
+		if(memory[watches[k]] == watch_val[k]) continue;
+		put_str("Watchpoint: cell ");
+		put_num(watches[k]);
+		put_str(" changed from ");
+		put_num((unsigned char)watch_val[k]);
+		put_str(" to ");
+		put_num((unsigned char)memory[watches[k]]);
+		put_str("\n");
+		watch_val[k] = memory[watches[k]];
+	}
+}
+
+/* A write hit a read only page. If it is a watched tape page, open it up
+ * and step the one instruction, otherwise crash as usual.
+ */
+static void on_segv(int sig, siginfo_t *si, void *ctx) {
+	ucontext_t *uc = ctx;
+	char *addr = si->si_addr;
+
+	if(!watching || addr < memory || addr >= memory + BF_ARRAY_SIZE) {
+		signal(SIGSEGV, SIG_DFL); // The fault happens again, without us
+		return;
+	}
+	protect(PROT_READ | PROT_WRITE);
+	uc->uc_mcontext.gregs[REG_EFL] |= TRAP_FLAG;
+}
+
+/* The write has been stepped, close the pages again and report it
+ */
+static void on_trap(int sig, siginfo_t *si, void *ctx) {
+	ucontext_t *uc = ctx;
+	uc->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+	check_watches();
+	protect(PROT_READ);
+}
+#endif
+
+/* Adds a watchpoint, and arms watchpoints the first time
+ * @param cell The cell to watch
+ * @return 0 if everything went well, 1 otherwise (int)
+ */
+int add_watch(int cell) {
+#ifdef HAVE_WATCH
+	struct sigaction sa;
+
+	if(num_watches == MAX_WATCHES || cell < 0 || cell >= BF_ARRAY_SIZE
+			|| sysconf(_SC_PAGESIZE) > TAPE_PAGE) {
+		fprintf(stderr, "Error: watchpoint on cell %d could not be set.\n", cell);
+		return 1;
+	}
+	if(!watching) {
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_flags = SA_SIGINFO;
+		sa.sa_sigaction = on_segv;
+		sigaction(SIGSEGV, &sa, NULL);
+		sa.sa_sigaction = on_trap;
+		sigaction(SIGTRAP, &sa, NULL);
+		watching = 1;
+	}
+	watches[num_watches] = cell;
+	watch_val[num_watches] = memory[cell];
+	num_watches++;
+	protect(PROT_READ);
+	return 0;
+#else
+	fprintf(stderr, "Error: watchpoints need Linux on x86.\n");
+	return 1;
+#endif
+}
+
+/* Opens the watched pages, before the kernel writes to the tape (block
+ * reads), since a system call fails rather than faulting
+ */
+void watch_pause() {
+#ifdef HAVE_WATCH
+	protect(PROT_READ | PROT_WRITE);
+#endif
+}
+
+/* Closes the watched pages again, reporting anything the kernel changed
+ */
+void watch_resume() {
+#ifdef HAVE_WATCH
+	check_watches();
+	protect(PROT_READ);
+#endif
+}
@@ -0,0 +1,54 @@
+#ifndef SIMPLELANGDEBUG_H
+#define SIMPLELANGDEBUG_H
+
+/* Breakpoints and watchpoints that cost nothing until they are hit.
+ *
+ * A breakpoint overwrites the op that covers a source position in the
+ * compiled code with OP_BREAK, and keeps the op it replaced in a side
+ * table. OP_BREAK stops, then runs the saved op with the operands that are
+ * still in place. Fused ops and closed form loops end at breakpoints, so
+ * the tape is as the source says when one stops: a fused op may start at
+ * a breakpoint, and a closed form loop may start with one, but neither
+ * covers one after its first op.
+ *
+ * A watchpoint makes the tape page holding its cell read only. A write to
+ * the page faults, the page is opened up for one instruction (using the
+ * trap flag to step it) and closed again, and changes to watched cells
+ * are reported. Writes to other cells on the page only pay for the fault.
+ * Watchpoints need Linux on x86.
+ */
+
+#define OP_BREAK     0x12 // Opcode, just after OP_CLOSED
+#define MAX_BREAKS   64   // Most breakpoints
+#define MAX_WATCHES  16   // Most watchpoints
+#define TAPE_PAGE    4096 // Alignment of the tape, watched a page at a time
+
+// variables defined in SimpleLangdebug.c
+extern int num_breaks;
+extern int watching;
+
+int add_break(long);
+int add_watch(int);
+int* break_positions(char*);
+void move_breaks(int*, int*);
+char* break_stops(int*, int);
+void patch_breaks(char*, int*);
+int run_break(char*);
+void watch_pause();
+void watch_resume();
+
+/* Checks whether a breakpoint falls in a stretch of code after its first op
+ * @param stops Flags from break_stops(), or NULL for none
+ * @param i The start of the stretch
+ * @param j The end of the stretch
+ * @return 1 if one does, 0 otherwise (int)
+ */
+static inline int stops_inside(char *stops, int i, int j) {
+	if(stops == NULL) return 0;
+	for(int p = i+1; p < j; p++) {
+		if(stops[p]) return 1;
+	}
+	return 0;
+}
+
+#endif // SIMPLELANGDEBUG_H
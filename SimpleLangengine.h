@@ -0,0 +1,65 @@
+/* One width of the wide cell engine, see SimpleLangcell.h. Included by
+ * SimpleLangcell.c once per width, with
+ * 		CELL   The cell type
+ * 		ENGINE The name of the function to define
+ * The code is parsed code, without fused ops or closed form loops.
+ */
+
+/* Runs parsed code on the wide tape
+ * @param buf The code
+ * @param len The length of buf
+ * @return an error code, or 0 if everything runs fine
+ */
+static int ENGINE(char *buf, int len) {
+	CELL *tape = wide_tape;
+	int offset;
+
+	for(int i = 0; i < len; i++) {
+		offset = 0;
+		switch(buf[i]) {
+			case '+':
+				++ tape[where];
+				break;
+			case '-':
+				-- tape[where];
+				break;
+			case '<':
+				where --;
+				wrap_where();
+				break;
+			case '>':
+				where ++;
+				wrap_where();
+				break;
+			case '[':
+				if(tape[where] == 0) {
+					offset = *((int*)&buf[i+1])-1;
+				} else {
+					offset = sizeof(int);
+				}
+				break;
+			case ']':
+				offset = *((int*)&buf[i+1])-1;
+				break;
+			default: // I/O goes through the byte ops
+				offset = wide_io(buf[i], &buf[i+1]);
+				break;
+		}
+
+		// Count the op, and whether it entered a loop body
+		if(perf_stats) {
+			stat_ops[(unsigned char)buf[i]]++;
+			if(buf[i] == '[' && offset == sizeof(int)) stat_loops++;
+		}
+		i += offset;
+
+		// Handle errors
+		if(where < 0) {
+			PROBE(runtime__error, where, i-1, buf[i]);
+			printf("Runtime error at operation %d; %c\n", i-1, buf[i]);
+			printf("  : %s\n", get_error(where));
+			return where;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef __WIN32__
+	#include <pthread.h>
+#endif
+
+#include "SimpleLang.h"
+#include "SimpleLangsuper.h"
+#include "SimpleLangloop.h"
+#include "SimpleLangnest.h"
+#include "SimpleLangfork.h"
+
+/*** EXTERNAL VARIABLES ***/
+// Fork extension control variable (Y and | ops)
+int forking = 0;
+// The first runtime error any thread hit, 0 while all is well
+int thread_err = 0;
+/**************************/
+
+#ifndef __WIN32__
+
+// Where a new thread starts
+struct start {
+	char *buf; // The compiled code
+	int len;   // The length of buf
+	int at;    // The position of the first op to run
+	int where; // The thread's pointer
+};
+
+/*** INTERNAL VARIABLES ***/
+// Threads running, besides the first
+static int live = 0;
+// Threads forked by the current thread, and not joined yet
+static THREAD_LOCAL pthread_t kids[MAX_THREADS];
+static THREAD_LOCAL int num_kids = 0;
+/**************************/
+
+/* Runs a forked thread to the end of the program, then waits for the
+ * threads it forked
+ * @param arg Where to start (struct start*, freed here)
+ */
+static void* thread_main(void *arg) {
+	struct start s = *(struct start*)arg;
+	free(arg);
+
+	where = s.where;
+	execute_from(s.buf, s.len, s.at);
+	join_all();
+	__atomic_sub_fetch(&live, 1, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+#endif
+
+/* Enables the fork extension, and turns off the passes whose ops are not
+ * safe to run on a shared tape
+ * @return 0 if everything went well, 1 otherwise (int)
+ */
+int fork_begin() {
+#ifdef __WIN32__
+	fprintf(stderr, "Error: --fork needs pthreads.\n");
+	return 1;
+#else
+	forking = 1;
+	superops = 0;
+	closed_loops = 0;
+	par_nests = 0;
+	return 0;
+#endif
+}
+
+/* Records a runtime error, so the other threads stop
+ * @param err The error code
+ */
+void fork_error(int err) {
+	int none = 0;
+	__atomic_compare_exchange_n(&thread_err, &none, err, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/* Runs a Y: forks a thread that runs the rest of the program
+ * @param buf The compiled code
+ * @param len The length of buf
+ * @param at The position of the op after the Y
+ */
+void run_fork(char *buf, int len, int at) {
+#ifdef __WIN32__
+	where = THREAD_ERR;
+#else
+	struct start *s;
+	int child = where + 1;
+
+	if(child >= BF_ARRAY_SIZE) {
+		if(oob) {
+			where = INDEX_OOB;
+			return;
+		}
+		child -= BF_ARRAY_SIZE;
+	}
+	if(num_kids == MAX_THREADS || (s = malloc(sizeof(*s))) == NULL) {
+		where = THREAD_ERR;
+		return;
+	}
+	if(__atomic_add_fetch(&live, 1, __ATOMIC_RELAXED) > MAX_THREADS) {
+		__atomic_sub_fetch(&live, 1, __ATOMIC_RELAXED);
+		free(s);
+		where = THREAD_ERR;
+		return;
+	}
+
+	// Both cells are set before the thread exists, so it sees them. The
+	// whole tape is marked dirty on the first fork, while no other thread
+	// runs, so wrap_where() and mark_dirty() never write the range again.
+	memory[where] = 0;
+	memory[child] = 1;
+	mark_dirty(0, BF_ARRAY_SIZE-1);
+	s->buf = buf;
+	s->len = len;
+	s->at = at;
+	s->where = child;
+	if(pthread_create(&kids[num_kids], NULL, thread_main, s) != 0) {
+		__atomic_sub_fetch(&live, 1, __ATOMIC_RELAXED);
+		free(s);
+		where = THREAD_ERR;
+		return;
+	}
+	num_kids++;
+#endif
+}
+
+/* Waits for every thread the current thread forked to end
+ */
+void join_all() {
+#ifndef __WIN32__
+	if(num_kids == 0) return;
+	while(num_kids > 0)
+		pthread_join(kids[--num_kids], NULL);
+	// The threads raced on the dirty range, so the whole tape may be dirty
+	mark_dirty(0, BF_ARRAY_SIZE-1);
+#endif
+}
+
+/* Runs a |: waits for the threads the current thread forked, and stops
+ * if one of them failed
+ */
+void run_join() {
+	join_all();
+	if(thread_err) where = THREAD_HALT;
+}
@@ -0,0 +1,37 @@
+#ifndef SIMPLELANGFORK_H
+#define SIMPLELANGFORK_H
+
+/* Threads for SimpleLang++ (--fork), after Brainfork's Y.
+ *
+ * Y starts an OS thread that runs the rest of the program from the op
+ * after the Y, on the same tape. The forking thread's cell is set to 0, and
+ * the new thread's pointer starts one cell to the right, with that cell set
+ * to 1, so each side can tell which one it is. Every thread has its own
+ * pointer. | waits for every thread the current thread forked to end. A
+ * thread ends at the end of the program, and the program ends once all
+ * of them have.
+ *
+ * + and - are atomic, so threads may count on a shared cell without losing
+ * updates. Other ops read and write cells plainly, and a thread sees the
+ * writes of another in no particular order. Fused ops and closed form loops
+ * change several cells at once, so --fork turns them off. Breakpoints and
+ * watchpoints assume one thread, so --fork can't be used with --break or
+ * --watch.
+ *
+ * When a thread hits a runtime error, the others stop at their next ], and
+ * the program fails with that error.
+ */
+
+#define MAX_THREADS 64 // Most threads running at once, besides the first
+
+// variables defined in SimpleLangfork.c
+extern int forking;
+extern int thread_err;
+
+int fork_begin();
+void fork_error(int);
+void run_fork(char*, int, int);
+void run_join();
+void join_all();
+
+#endif // SIMPLELANGFORK_H
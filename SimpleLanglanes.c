@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "SimpleLang.h"
+#include "SimpleLangstats.h"
+#include "SimpleLanglanes.h"
+
+// One byte, or one int, per lane
+typedef signed char lane_bytes __attribute__((vector_size(LANES)));
+typedef int lane_ints __attribute__((vector_size(LANES * sizeof(int))));
+
+// The input and output of one lane
+struct lane {
+	char *in;      // The input line
+	int in_len;    // The length of in
+	int in_cap;    // The space allocated for in
+	int in_pos;    // The next byte , reads
+	char *out;     // The output so far
+	int out_len;   // The length of out
+	int out_cap;   // The space allocated for out
+};
+
+/*** INTERNAL VARIABLES ***/
+// The tape, a column per lane
+static lane_bytes tape[BF_ARRAY_SIZE];
+// Lanes that run the next op, and lanes that haven't failed (-1 or 0 each)
+static lane_bytes mask, alive;
+// Each lane's offset from the shared pointer, and -1 for lanes outside the mask
+static lane_ints delta, outside;
+// The shared pointer, and whether the lanes in the mask are on different cells
+static int ptr, diverged;
+// Lowest and highest cells used by this batch
+static int used_lo, used_hi;
+static struct lane lanes[LANES];
+/**************************/
+
+/* Checks whether any lane of a vector is set
+ * @param v The vector
+ * @param size The size of v in bytes
+ * @return 1 if any lane is not 0, 0 otherwise (int)
+ */
+static inline int any(void *v, int size) {
+	unsigned long long w[LANES * sizeof(int) / 8];
+	memcpy(w, v, size);
+	for(int k = 0; k < size / 8; k++) {
+		if(w[k]) return 1;
+	}
+	return 0;
+}
+
+/* Notes that a cell was used, so the next batch clears it
+ * @param cell The cell
+ */
+static inline void use(int cell) {
+	if(cell < used_lo) used_lo = cell;
+	if(cell > used_hi) used_hi = cell;
+}
+
+/* Changes the mask. If the lanes in it are all on one cell, that cell
+ * becomes the shared pointer.
+ * @param m The new mask
+ */
+static void set_mask(lane_bytes m) {
+	lane_ints in;
+	int first = -1;
+
+	mask = m & alive;
+	in = __builtin_convertvector(mask, lane_ints);
+	outside = ~in;
+
+	for(int l = 0; l < LANES && first < 0; l++) {
+		if(mask[l]) first = l;
+	}
+	if(first < 0) {
+		diverged = 1; // No lane runs, and none touches the tape
+		return;
+	}
+	lane_ints off = (delta - delta[first]) & in;
+	diverged = any(&off, sizeof(off));
+	if(!diverged && delta[first] != 0) {
+		ptr += delta[first];
+		delta -= delta[first];
+	}
+}
+
+/* Appends a byte to a lane's output
+ * @param ln The lane
+ * @param c The byte
+ * @return 0 if everything went well, MEMORY_ERR otherwise (int)
+ */
+static int put(struct lane *ln, char c) {
+	char *tmp;
+	if(ln->out_len == ln->out_cap) {
+		tmp = realloc(ln->out, ln->out_cap ? ln->out_cap*2 : BUF_SIZE);
+		if(tmp == NULL) return MEMORY_ERR;
+		ln->out = tmp;
+		ln->out_cap = ln->out_cap ? ln->out_cap*2 : BUF_SIZE;
+	}
+	ln->out[ln->out_len++] = c;
+	return 0;
+}
+
+/* Stops a lane after a runtime error, which goes in its output
+ * @param l The lane
+ * @param err The error code
+ * @param i The position of the op
+ * @param op The op
+ */
+static void fail(int l, int err, int i, char op) {
+	char msg[128];
+	int n = snprintf(msg, sizeof(msg), "Runtime error at operation %d; %c\n  : %s\n", i-1, op, get_error(err));
+	for(int k = 0; k < n; k++) put(&lanes[l], msg[k]);
+	alive[l] = 0;
+	set_mask(mask);
+}
+
+/* Moves the pointer of the lanes in the mask
+ * @param step 1 for >, -1 for <
+ * @param i The position of the op, for errors
+ * @param op The op, for errors
+ */
+static void move(int step, int i, char op) {
+	int at;
+
+	ptr += step;
+	delta += outside * step; // Lanes outside the mask stay put
+	if(!diverged) {
+		if(ptr >= 0 && ptr < BF_ARRAY_SIZE) {
+			use(ptr);
+			return;
+		}
+		if(!any(&mask, sizeof(mask))) return;
+		if(!oob) {
+			step = (ptr < 0) ? BF_ARRAY_SIZE : -BF_ARRAY_SIZE;
+			ptr += step;
+			delta += outside * step;
+			use(ptr);
+			return;
+		}
+	}
+
+	// Lane by lane
+	for(int l = 0; l < LANES; l++) {
+		if(!mask[l]) continue;
+		at = ptr + delta[l];
+		if(at >= 0 && at < BF_ARRAY_SIZE) {
+			use(at);
+		} else if(oob) {
+			fail(l, INDEX_OOB, i, op);
+		} else {
+			delta[l] += (at < 0) ? BF_ARRAY_SIZE : -BF_ARRAY_SIZE;
+			use(ptr + delta[l]);
+		}
+	}
+}
+
+/* Gets the current cell of every lane in the mask
+ * @return The cells, 0 for lanes outside the mask (lane_bytes)
+ */
+static inline lane_bytes cells() {
+	lane_bytes c = {0};
+	if(!diverged) return tape[ptr] & mask;
+	for(int l = 0; l < LANES; l++) {
+		if(mask[l]) c[l] = tape[ptr + delta[l]][l];
+	}
+	return c;
+}
+
+/* Runs parsed code on a batch of lanes
+ * @param buf The parsed code
+ * @param len The length of buf
+ * @param n The number of lanes with input
+ * @return 0 if everything went well, MEMORY_ERR otherwise (int)
+ */
+static int run_batch(char *buf, int len, int n) {
+	lane_bytes stack[MAX_LOOPS], c, m;
+	int sp = 0, at;
+
+	memset(&tape[used_lo], 0, (used_hi - used_lo + 1) * sizeof(lane_bytes));
+	used_lo = used_hi = ptr = 0;
+	for(int l = 0; l < LANES; l++) {
+		alive[l] = (l < n) ? -1 : 0;
+		delta[l] = 0;
+	}
+	set_mask(alive);
+
+	for(int i = 0; i < len; ) {
+		switch(buf[i]) {
+			case '+':
+				if(!diverged) {
+					tape[ptr] -= mask; // -1 in the mask
+				} else {
+					for(int l = 0; l < LANES; l++)
+						if(mask[l]) tape[ptr + delta[l]][l]++;
+				}
+				i++;
+				break;
+			case '-':
+				if(!diverged) {
+					tape[ptr] += mask;
+				} else {
+					for(int l = 0; l < LANES; l++)
+						if(mask[l]) tape[ptr + delta[l]][l]--;
+				}
+				i++;
+				break;
+			case '>':
+				move(1, i, '>');
+				i++;
+				break;
+			case '<':
+				move(-1, i, '<');
+				i++;
+				break;
+			case '.':
+				for(int l = 0; l < LANES; l++) {
+					if(mask[l] && put(&lanes[l], tape[ptr + delta[l]][l]) != 0) return MEMORY_ERR;
+				}
+				i++;
+				break;
+			case ',':
+				for(int l = 0; l < LANES; l++) {
+					if(!mask[l]) continue;
+					at = ptr + delta[l];
+					if(lanes[l].in_pos < lanes[l].in_len)
+						tape[at][l] = lanes[l].in[lanes[l].in_pos++];
+					else
+						tape[at][l] = (char)EOF;
+				}
+				i++;
+				break;
+			case '[':
+				c = cells();
+				m = mask & (c != 0);
+				if(!any(&m, sizeof(m))) {
+					i += *((int*)&buf[i+1]); // Just after the loop end
+					break;
+				}
+				stack[sp++] = mask;
+				set_mask(m);
+				i += 1 + sizeof(int);
+				break;
+			case ']':
+				c = cells();
+				m = mask & (c != 0);
+				if(any(&m, sizeof(m))) {
+					lane_bytes x = m ^ mask;
+					if(any(&x, sizeof(x))) set_mask(m); // Some lanes are done
+					i += *((int*)&buf[i+1]) + 1 + sizeof(int); // The loop body
+				} else {
+					set_mask(stack[--sp]);
+					i += 1 + sizeof(int);
+				}
+				break;
+			default:
+				i++;
+				break;
+		}
+		if(!any(&alive, sizeof(alive))) break;
+	}
+	return 0;
+}
+
+/* Reads a line of input for a lane, with its newline
+ * @param fp The stream
+ * @param ln The lane
+ * @return 1 if a line was read, 0 at EOF, MEMORY_ERR on error (int)
+ */
+static int read_line(FILE *fp, struct lane *ln) {
+	int c;
+	char *tmp;
+
+	ln->in_len = ln->in_pos = 0;
+	while((c = getc(fp)) != EOF) {
+		if(ln->in_len == ln->in_cap) {
+			tmp = realloc(ln->in, ln->in_cap ? ln->in_cap*2 : BUF_SIZE);
+			if(tmp == NULL) return MEMORY_ERR;
+			ln->in = tmp;
+			ln->in_cap = ln->in_cap ? ln->in_cap*2 : BUF_SIZE;
+		}
+		ln->in[ln->in_len++] = (char)c;
+		if(c == '\n') break;
+	}
+	return ln->in_len > 0;
+}
+
+/* Runs a program over every line of stdin, a batch of lanes at a time
+ * @param fname The program's source file
+ * @return 0 if everything went well, 1 otherwise (int)
+ */
+int run_lanes(char *fname) {
+	char *raw = read_source(fname), *buf = NULL;
+	int len, n, ret = 0;
+
+	if(raw == NULL) return 1;
+	len = parse(raw, &buf);
+	free(raw);
+	if(len < 0) {
+		printf("Error: %s\n", get_error(len));
+		return 1;
+	}
+
+	while(ret == 0) {
+		for(n = 0; n < LANES; n++) {
+			IO_TIME(IO_STDIO, ret = read_line(stdin, &lanes[n]));
+			if(ret <= 0) break;
+		}
+		if(ret < 0 || n == 0) break;
+		ret = run_batch(buf, len, n);
+		for(int l = 0; l < n; l++) {
+			IO_TIME(IO_STDIO, fwrite(lanes[l].out, 1, lanes[l].out_len, stdout));
+			lanes[l].out_len = 0;
+		}
+	}
+	if(ret < 0) fprintf(stderr, "Error: %s\n", get_error(ret));
+
+	for(int l = 0; l < LANES; l++) {
+		free(lanes[l].in);
+		free(lanes[l].out);
+		lanes[l].in = lanes[l].out = NULL;
+		lanes[l].in_cap = lanes[l].out_cap = 0;
+	}
+	free(buf);
+	return ret < 0;
+}
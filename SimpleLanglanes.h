@@ -0,0 +1,29 @@
+#ifndef SIMPLELANGLANES_H
+#define SIMPLELANGLANES_H
+
+/* Batch mode (--lanes): runs one program over many independent inputs at
+ * once, one input per SIMD lane. Each line of stdin is an input. Each lane
+ * has its own column of the tape, and reads its line with , (then EOF).
+ * The output of each line is printed in input order.
+ *
+ * Lanes run the same op at the same time. A lane mask picks the lanes a
+ * loop body runs for: [ drops the lanes whose cell is 0, and ] goes round
+ * while any lane is left, then brings the lanes back. The pointer is
+ * shared. Lanes outside the mask keep an offset from it, so that they
+ * stay where they were. While every lane in the mask is on the same
+ * cell, + - [ and ] are a single vector op. Otherwise they run lane by
+ * lane until the pointers line up again.
+ *
+ * The lanes are GCC vectors, 32 wide when built with AVX2 (-mavx2) and 16
+ * otherwise (SSE2). Only plain SimpleLang ops run in lanes.
+ */
+
+#ifdef __AVX2__
+	#define LANES 32
+#else
+	#define LANES 16
+#endif
+
+int run_lanes(char*);
+
+#endif // SIMPLELANGLANES_H
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "SimpleLang.h"
+#include "SimpleLangstats.h"
+#include "SimpleLangloop.h"
+#include "SimpleLangdebug.h"
+
+/*** EXTERNAL VARIABLES ***/
+// Closed form control variable, if set to 0 loops always run one pass at a time
+int closed_loops = 1;
+/**************************/
+
+#define CONST MAX_CLOSED_CELLS // Column of the constant term, and its row
+
+// The effect of some code on the cells near the pointer, as an affine map
+// mod 256. Row k gives the new value of cell k from the old value of every
+// cell, plus the constant in column CONST. Unused rows stay the identity.
+struct affine {
+	int d;                     // Number of cells
+	int off[MAX_CLOSED_CELLS]; // Offset of each cell from the pointer at loop start
+	int lo, hi;                // Lowest and highest the pointer goes, from the loop start
+	unsigned char m[MAX_CLOSED_CELLS+1][MAX_CLOSED_CELLS+1];
+};
+
+/* Resets a map to do nothing
+ * @param a The map
+ */
+static void identity(struct affine *a) {
+	memset(a, 0, sizeof(*a));
+	for(int k = 0; k <= CONST; k++) a->m[k][k] = 1;
+}
+
+/* Finds a cell in a map
+ * @param a The map
+ * @param off The cell's offset
+ * @return The cell's row, or -1 if the map doesn't touch it (int)
+ */
+static int find(struct affine *a, int off) {
+	for(int k = 0; k < a->d; k++) {
+		if(a->off[k] == off) return k;
+	}
+	return -1;
+}
+
+/* Finds a cell in a map, adding it if it isn't there yet
+ * @param a The map
+ * @param off The cell's offset
+ * @return The cell's row, or -1 if the map is full (int)
+ */
+static int cell(struct affine *a, int off) {
+	int k = find(a, off);
+	if(k >= 0 || a->d == MAX_CLOSED_CELLS) return k;
+	a->off[a->d] = off;
+	return a->d++;
+}
+
+/* Gets the inverse of an odd number mod 256
+ * @param s The number
+ * @return x, where s*x is 1 mod 256 (unsigned char)
+ */
+static unsigned char inverse(unsigned char s) {
+	unsigned char x = s; // s*s is 1 mod 8, each step doubles the good bits
+	for(int k = 0; k < 3; k++) x *= 2 - s*x;
+	return x;
+}
+
+/* Adds an inner loop to a map. The loop's body must only add constants, so
+ * it runs (counter * multiplier) times and adds that many of each constant.
+ * @param a The map so far
+ * @param b The loop body's map
+ * @param p The offset of the loop's counter
+ * @return 0 if everything went well, -1 if the loop has no closed form (int)
+ */
+static int add_inner(struct affine *a, struct affine *b, int p) {
+	int c = find(b, p), ca, ka;
+	unsigned char mul, coef;
+
+	// The counter must move by an odd amount, or the loop may never end
+	if(c < 0 || (b->m[c][CONST] & 1) == 0) return -1;
+	mul = -inverse(b->m[c][CONST]);
+	if((ca = cell(a, p)) < 0) return -1;
+
+	for(int k = 0; k < b->d; k++) {
+		if(k == c || b->m[k][CONST] == 0) continue;
+		if((ka = cell(a, b->off[k])) < 0) return -1;
+		coef = b->m[k][CONST] * mul;
+		for(int col = 0; col <= CONST; col++)
+			a->m[ka][col] += coef * a->m[ca][col];
+	}
+	memset(a->m[ca], 0, CONST+1); // The counter ends at 0
+	return 0;
+}
+
+/* Builds the map for a stretch of parsed code
+ * @param buf The parsed code
+ * @param i The start of the stretch
+ * @param end Just after the end of the stretch
+ * @param p The offset of the pointer at the start
+ * @param depth How many loops deep the stretch is, inside the outer loop
+ * @param a The map, updated in place
+ * @return 0 if everything went well, -1 if there is no closed form (int)
+ */
+static int analyze(char *buf, int i, int end, int p, int depth, struct affine *a) {
+	struct affine b;
+	int start = p, k, j;
+
+	while(i < end) {
+		switch(buf[i]) {
+			case '+': case '-':
+				if((k = cell(a, p)) < 0) return -1;
+				a->m[k][CONST] += (buf[i] == '+') ? 1 : -1;
+				i++;
+				break;
+			case '<':
+				p--;
+				if(p < a->lo) a->lo = p;
+				i++;
+				break;
+			case '>':
+				p++;
+				if(p > a->hi) a->hi = p;
+				i++;
+				break;
+			case '[':
+				if(depth > 0) return -1; // Inner loops must only add constants
+				j = i + *((int*)&buf[i+1]); // Just after the loop end
+				identity(&b);
+				if(analyze(buf, i+1+sizeof(int), j-1-sizeof(int), p, depth+1, &b) != 0) return -1;
+				if(add_inner(a, &b, p) != 0) return -1;
+				if(b.lo < a->lo) a->lo = b.lo;
+				if(b.hi > a->hi) a->hi = b.hi;
+				i = j;
+				break;
+			default: // I/O, or anything else that isn't arithmetic
+				return -1;
+		}
+		if(p > BF_ARRAY_SIZE/2 || p < -BF_ARRAY_SIZE/2) return -1;
+	}
+	return (p == start) ? 0 : -1;
+}
+
+/* Checks whether the loop at some position has a closed form
+ * @param buf The parsed code
+ * @param i The position of the loop start
+ * @param a Where to store the map for one pass of the loop
+ * @param mul Where to store the trip count multiplier
+ * @return The position just after the loop end, or 0 if there is no closed form (int)
+ */
+static int closed_loop(char *buf, int i, struct affine *a, unsigned char *mul) {
+	int j = i + *((int*)&buf[i+1]), c;
+
+	identity(a);
+	if(analyze(buf, i+1+sizeof(int), j-1-sizeof(int), 0, 0, a) != 0) return 0;
+
+	// The counter may only depend on itself, and moves by an odd amount
+	if((c = find(a, 0)) < 0 || a->m[c][c] != 1 || (a->m[c][CONST] & 1) == 0) return 0;
+	for(int col = 0; col < a->d; col++) {
+		if(col != c && a->m[c][col] != 0) return 0;
+	}
+	*mul = -inverse(a->m[c][CONST]);
+	return j;
+}
+
+/* Writes the operands of a closed form op, up to the original loop
+ * @param out Where to write
+ * @param a The map for one pass of the loop
+ * @param mul The trip count multiplier
+ * @return The number of bytes written (int)
+ */
+static int encode(char *out, struct affine *a, unsigned char mul) {
+	int o = 0, linear = 1;
+
+	for(int k = 0; k < a->d; k++) {
+		for(int col = 0; col < a->d; col++) {
+			if(a->m[k][col] != (k == col)) linear = 0;
+		}
+	}
+	out[o++] = (char)a->d;
+	out[o++] = linear ? CLOSED_LINEAR : 0;
+	out[o++] = (char)mul;
+	memcpy(&out[o], &a->lo, sizeof(int));
+	memcpy(&out[o + sizeof(int)], &a->hi, sizeof(int));
+	o += 2*sizeof(int);
+	memcpy(&out[o], a->off, a->d * sizeof(int));
+	o += a->d * sizeof(int);
+	for(int k = 0; k < a->d; k++) {
+		for(int col = 0; col < a->d; col++)
+			out[o++] = (char)a->m[k][col];
+		out[o++] = (char)a->m[k][CONST];
+	}
+	return o;
+}
+
+/* Replaces every loop nest that has a closed form with a single op.
+ * Loop addresses are rebuilt for the new layout.
+ * @param buf The parsed code, as returned by parse()
+ * @param len The length of buf
+ * @param arr Where to store the new code (created using malloc)
+ * @param map If not NULL, where to store the position in the new code of
+ * 		the op that covers each position of buf
+ * @param stops If not NULL, breakpoints that a closed form may only start at
+ * @return The length of the new code, or MEMORY_ERR (int)
+ */
+int closed_form(char *buf, int len, char **arr, int *map, char *stops) {
+	struct affine a;
+	unsigned char mul;
+	int o = 0, j, start, sp = 0, open;
+	int loopstack[MAX_LOOPS];
+
+	// A loop is at least 2+2*sizeof(int) bytes, and may get a header
+	char *out = malloc(len + (len / (2 + 2*sizeof(int)) + 1) * MAX_CLOSED_HEADER);
+	if(out == NULL) return MEMORY_ERR;
+
+	for(int i = 0; i < len; ) {
+		if(buf[i] == '[' && (j = closed_loop(buf, i, &a, &mul)) > 0 && !stops_inside(stops, i, j)) {
+			// Closed form op, followed by the loop as it was
+			start = o;
+			out[o] = OP_CLOSED;
+			o += 1 + sizeof(int);
+			o += encode(&out[o], &a, mul);
+			memcpy(&out[o], &buf[i], j-i);
+			o += j-i;
+			*((int*)&out[start+1]) = o - (start+1+sizeof(int));
+			if(map != NULL) {
+				for(int p = i; p < j; p++) map[p] = start;
+			}
+			i = j;
+			continue;
+		}
+
+		// Copy the op as it is
+		memcpy(&out[o], &buf[i], ir_size(buf[i]));
+		if(buf[i] == '[') {
+			loopstack[sp++] = o;
+		} else if(buf[i] == ']') {
+			open = loopstack[--sp];
+			*((int*)&out[o+1]) = open-o;
+			*((int*)&out[open+1]) = o+1+sizeof(int)-open;
+		}
+		if(map != NULL) {
+			for(int p = i; p < i+ir_size(buf[i]); p++) map[p] = o;
+		}
+		o += ir_size(buf[i]);
+		i += ir_size(buf[i]);
+	}
+
+	*arr = out;
+	return o;
+}
+
+/* Multiplies two maps, both square matrices with the constant last
+ * @param n The size of the matrices, cells plus one
+ * @param x The left matrix
+ * @param y The right matrix
+ * @param out Where to store x*y, may not be x or y
+ */
+static void mat_mul(int n, unsigned char x[][MAX_CLOSED_CELLS+1],
+		unsigned char y[][MAX_CLOSED_CELLS+1], unsigned char out[][MAX_CLOSED_CELLS+1]) {
+	unsigned int sum;
+	for(int r = 0; r < n; r++) {
+		for(int c = 0; c < n; c++) {
+			sum = 0;
+			for(int k = 0; k < n; k++) sum += x[r][k] * y[k][c];
+			out[r][c] = (unsigned char)sum;
+		}
+	}
+}
+
+/* Runs a closed form op
+ * @param next The op's operands
+ * @return The offset to apply to the code pointer
+ */
+int run_closed(char *next) {
+	unsigned char *p = (unsigned char*)next + sizeof(int);
+	int d = p[0], flags = p[1], size = *((int*)next);
+	int header = 3 + 2*sizeof(int) + d*(sizeof(int) + d+1);
+	unsigned char *cells = p + 3 + 2*sizeof(int), *rows = cells + d*sizeof(int);
+	unsigned char m[MAX_CLOSED_CELLS+1][MAX_CLOSED_CELLS+1], r[MAX_CLOSED_CELLS+1][MAX_CLOSED_CELLS+1];
+	unsigned char t[MAX_CLOSED_CELLS+1][MAX_CLOSED_CELLS+1];
+	unsigned char x[MAX_CLOSED_CELLS+1], v[MAX_CLOSED_CELLS];
+	unsigned int n, trips, sum;
+	int idx[MAX_CLOSED_CELLS], off, lo, hi;
+
+	n = ((unsigned char)memory[where] * p[2]) & 0xff; // Trip count
+	if(n == 0) return sizeof(int) + size;
+	trips = n;
+
+	// A pointer move off the tape is an error, even if no cell there is touched
+	memcpy(&lo, &p[3], sizeof(int));
+	memcpy(&hi, &p[3 + sizeof(int)], sizeof(int));
+	if(oob && (where+lo < 0 || where+hi >= BF_ARRAY_SIZE))
+		return sizeof(int) + header; // Run the loop, it errors where it should
+
+	for(int k = 0; k < d; k++) {
+		memcpy(&off, &cells[k*sizeof(int)], sizeof(int));
+		idx[k] = where + off;
+		if(idx[k] < 0 || idx[k] >= BF_ARRAY_SIZE) {
+			if(oob) return sizeof(int) + header; // Run the loop, it errors where it should
+			idx[k] = (idx[k] + BF_ARRAY_SIZE) % BF_ARRAY_SIZE;
+		}
+		x[k] = (unsigned char)memory[idx[k]];
+	}
+	x[d] = 1;
+
+	if(flags & CLOSED_LINEAR) {
+		for(int k = 0; k < d; k++)
+			v[k] = x[k] + n * rows[k*(d+1) + d];
+	} else {
+		// Raise the map to the power n by squaring
+		for(int k = 0; k <= d; k++) {
+			for(int c = 0; c <= d; c++) {
+				m[k][c] = (k < d) ? rows[k*(d+1) + c] : (c == d);
+				r[k][c] = (k == c);
+			}
+		}
+		while( 1 ) {
+			if(n & 1) {
+				mat_mul(d+1, r, m, t);
+				memcpy(r, t, sizeof(r));
+			}
+			n >>= 1;
+			if(n == 0) break;
+			mat_mul(d+1, m, m, t);
+			memcpy(m, t, sizeof(m));
+		}
+		for(int k = 0; k < d; k++) {
+			sum = 0;
+			for(int c = 0; c <= d; c++) sum += r[k][c] * x[c];
+			v[k] = (unsigned char)sum;
+		}
+	}
+
+	for(int k = 0; k < d; k++) {
+		memory[idx[k]] = (char)v[k];
+		mark_dirty(idx[k], idx[k]);
+	}
+	if(perf_stats) stat_loops += trips; // Passes of the outer loop only
+	return sizeof(int) + size;
+}
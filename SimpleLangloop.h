@@ -0,0 +1,31 @@
+#ifndef SIMPLELANGLOOP_H
+#define SIMPLELANGLOOP_H
+
+/* Closed form loop nests. A loop with no I/O, that ends where it started,
+ * and whose counter (the cell it tests) changes by the same odd amount
+ * every time round, has an effect on the tape that is an affine map mod 256
+ * raised to the power of its trip count. Inner loops may nest one deep if
+ * their bodies only add constants. Such a nest is replaced by one op:
+ * 		OP_CLOSED [int size] [1 byte cells d] [1 byte flags] [1 byte trip count multiplier]
+ * 		          [int lo] [int hi] [d ints, cell offsets] [d rows of d+1 bytes, the map]
+ * 		          [the original loop]
+ * where size covers everything after it, and lo and hi are the lowest and
+ * highest the pointer goes, from where the loop starts. The original loop
+ * is kept, and runs instead when the pointer or a cell would be off the end
+ * of the tape, so errors happen as before.
+ */
+
+#define OP_CLOSED        0x11 // Opcode, just after the fused ops
+#define MAX_CLOSED_CELLS 8    // Most cells a closed form nest may touch
+#define CLOSED_LINEAR    1    // Flag, the map only adds constants
+
+// Largest op header, in front of the original loop
+#define MAX_CLOSED_HEADER (1 + sizeof(int) + 3 + 2*sizeof(int) + MAX_CLOSED_CELLS*(sizeof(int) + MAX_CLOSED_CELLS+1))
+
+// variables defined in SimpleLangloop.c
+extern int closed_loops;
+
+int closed_form(char*, int, char**, int*, char*);
+int run_closed(char*);
+
+#endif // SIMPLELANGLOOP_H
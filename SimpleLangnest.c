@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef __WIN32__
+	#include <pthread.h>
+	#include <unistd.h> //sysconf
+#endif
+
+#include "SimpleLang.h"
+#include "SimpleLangsuper.h"
+#include "SimpleLangloop.h"
+#include "SimpleLangnest.h"
+
+/*** EXTERNAL VARIABLES ***/
+// Parallel nests control variable, if set to 0 loop nests always run one after another
+int par_nests = 1;
+/**************************/
+
+// The cells some code goes near, from the pointer where it starts
+struct range {
+	int lo, hi;
+};
+
+// A run of loops that may run side by side, while it is being found. Each
+// loop comes with the + - < and > just before it, which set it up.
+struct group {
+	int n;                    // Number of loops
+	int first;                // Position of the first loop's setup
+	int last;                 // Just after the last loop
+	int p;                    // Pointer offset so far, from the start of the run
+	int end;                  // Pointer offset at the last loop
+	struct range all;         // Cells the run goes near
+	int at[MAX_NESTS];        // Position of each loop's setup
+	int stop[MAX_NESTS];      // Just after each loop
+	int base[MAX_NESTS];      // Pointer offset at each loop's setup
+	struct range r[MAX_NESTS];// Cells each loop and its setup touch
+};
+
+/* Finds the cells a stretch of code goes near
+ * @param buf The code, after closed_form()
+ * @param i The start of the stretch
+ * @param end Just after the end of the stretch
+ * @param p The offset of the pointer at the start
+ * @param r The range so far, updated in place
+ * @return The number of loops in the stretch, not counting closed form ones,
+ * 		or -1 if it does I/O or a loop doesn't end where it started (int)
+ */
+static int reach(char *buf, int i, int end, int p, struct range *r) {
+	int start = p, loops = 0, n, j, d;
+
+	while(i < end) {
+		switch(buf[i]) {
+			case '+': case '-':
+				i++;
+				break;
+			case '<':
+				p--;
+				i++;
+				break;
+			case '>':
+				p++;
+				i++;
+				break;
+			case '[':
+				j = i + *((int*)&buf[i+1]); // Just after the loop end
+				if((n = reach(buf, i+1+sizeof(int), j-1-sizeof(int), p, r)) < 0) return -1;
+				loops += n + 1;
+				i = j;
+				break;
+			case OP_CLOSED: // The loop it keeps touches the same cells
+				d = (unsigned char)buf[i+1+sizeof(int)];
+				j = i + op_size(&buf[i]);
+				if(reach(buf, i+1+sizeof(int) + 3 + 2*sizeof(int) + d*(sizeof(int)+d+1), j, p, r) < 0) return -1;
+				i = j;
+				break;
+			default: // I/O, or anything else that isn't arithmetic
+				return -1;
+		}
+		if(p < r->lo) r->lo = p;
+		if(p > r->hi) r->hi = p;
+		if(p > BF_ARRAY_SIZE/2 || p < -BF_ARRAY_SIZE/2) return -1;
+	}
+	return (p == start) ? loops : -1;
+}
+
+/* Checks whether a loop would touch cells another loop in a run touches
+ * @param g The run
+ * @param r The cells the loop touches, from the first loop of the run
+ * @return 1 if it would, 0 otherwise (int)
+ */
+static int overlaps(struct group *g, struct range r) {
+	for(int k = 0; k < g->n; k++) {
+		if(r.lo <= g->r[k].hi && g->r[k].lo <= r.hi) return 1;
+	}
+	return 0;
+}
+
+/* Widens a range to hold a cell
+ * @param r The range
+ * @param p The cell
+ */
+static void widen(struct range *r, int p) {
+	if(p < r->lo) r->lo = p;
+	if(p > r->hi) r->hi = p;
+}
+
+/* Writes a run of loops, as one op if there is more than one, followed by
+ * the code after it, then empties the run
+ * @param buf The code
+ * @param g The run
+ * @param i The position just after the code to write
+ * @param out Where to write
+ * @return The number of bytes written, or MEMORY_ERR (int)
+ */
+static int flush(char *buf, struct group *g, int i, char *out) {
+	int o = 0, len, *head;
+	char *code;
+
+	if(g->n < 2) {
+		len = (g->n == 1) ? i - g->first : 0;
+		memcpy(out, &buf[g->first], len);
+		g->n = 0;
+		return len;
+	}
+
+	out[o] = OP_NESTS;
+	o += 1 + sizeof(int);
+	head = (int*)&out[o];
+	head[0] = g->n;
+	head[1] = g->all.lo;
+	head[2] = g->all.hi;
+	head[3] = g->end;
+	o += (4 + 2*g->n) * sizeof(int);
+
+	// Each loop's code, with its own fused ops
+	for(int k = 0; k < g->n; k++) {
+		code = &buf[g->at[k]];
+		len = g->stop[k] - g->at[k];
+		if(superops && (len = fuse(&buf[g->at[k]], len, &code, NULL, NULL)) < 0) return MEMORY_ERR;
+		memcpy(&out[o], code, len);
+		if(superops) free(code);
+		head[4 + 2*k] = g->base[k];
+		head[5 + 2*k] = len;
+		o += len;
+	}
+
+	// The code as it was
+	memcpy(&out[o], &buf[g->first], g->last - g->first);
+	o += g->last - g->first;
+	*((int*)&out[1]) = o - (1+sizeof(int));
+
+	// Code after the last loop
+	memcpy(&out[o], &buf[g->last], i - g->last);
+	o += i - g->last;
+	g->n = 0;
+	return o;
+}
+
+/* Replaces every run of loop nests that can run side by side with a single
+ * op. Runs only at the top level, so loop addresses don't change.
+ * @param buf The code, as returned by closed_form() or parse()
+ * @param len The length of buf
+ * @param arr Where to store the new code (created using malloc)
+ * @return The length of the new code, or MEMORY_ERR (int)
+ */
+int parallel_nests(char *buf, int len, char **arr) {
+	struct group *g;
+	struct range r, unit, span;
+	int o = 0, j, n = 0, setup = -1, base = 0;
+
+	// Fused loops are at most 3 times their size, and a run holds them
+	// and the original. A loop with a loop inside is at least 4+4*sizeof(int) bytes.
+	char *out = malloc(4*len + (len / (4 + 4*sizeof(int)) + 1) * MAX_NESTS_HEADER);
+	g = calloc(1, sizeof(*g));
+	if(out == NULL || g == NULL) {
+		free(out);
+		free(g);
+		return MEMORY_ERR;
+	}
+
+	for(int i = 0; i < len; ) {
+		switch(buf[i]) {
+			case '+': case '-': case '<': case '>':
+				if(setup < 0 && g->n == 0 && (buf[i] == '<' || buf[i] == '>')) break; // Not in a run
+				if(setup < 0) {
+					// A loop's setup starts here
+					if(g->n == 0) g->p = 0;
+					setup = i;
+					base = g->p;
+					unit.lo = BF_ARRAY_SIZE;
+					unit.hi = -BF_ARRAY_SIZE;
+					span.lo = span.hi = g->p;
+				}
+				if(buf[i] == '<' || buf[i] == '>') {
+					g->p += (buf[i] == '>') ? 1 : -1;
+					widen(&span, g->p); // Goes near the cell, but doesn't touch it
+				} else {
+					widen(&unit, g->p);
+				}
+				if(g->p > BF_ARRAY_SIZE/2 || g->p < -BF_ARRAY_SIZE/2) break;
+				i++;
+				continue;
+			case '[':
+				j = i + *((int*)&buf[i+1]); // Just after the loop end
+				r.lo = r.hi = 0;
+				// Only loops with a loop inside are worth a thread
+				if(reach(buf, i+1+sizeof(int), j-1-sizeof(int), 0, &r) <= 0) break;
+				if(setup < 0) {
+					if(g->n == 0) g->p = 0;
+					setup = i;
+					base = g->p;
+					unit.lo = BF_ARRAY_SIZE;
+					unit.hi = -BF_ARRAY_SIZE;
+					span.lo = span.hi = g->p;
+				}
+				widen(&unit, g->p + r.lo);
+				widen(&unit, g->p + r.hi);
+				if(g->n > 0 && (g->n == MAX_NESTS || overlaps(g, unit))) {
+					if((n = flush(buf, g, setup, &out[o])) < 0) break;
+					o += n;
+					// A new run starts at the setup
+					unit.lo -= base;
+					unit.hi -= base;
+					span.lo -= base;
+					span.hi -= base;
+					g->p -= base;
+					base = 0;
+				}
+				if(g->n == 0) {
+					g->first = setup;
+					g->all = span;
+				}
+				g->at[g->n] = setup;
+				g->stop[g->n] = j;
+				g->base[g->n] = base;
+				g->r[g->n++] = unit;
+				widen(&g->all, span.lo);
+				widen(&g->all, span.hi);
+				widen(&g->all, unit.lo);
+				widen(&g->all, unit.hi);
+				g->end = g->p;
+				g->last = i = j;
+				setup = -1;
+				continue;
+		}
+		if(n < 0) break;
+
+		// Anything else ends the run, and is copied as it is
+		if(g->n == 0 && setup >= 0) {
+			memcpy(&out[o], &buf[setup], i - setup);
+			o += i - setup;
+		} else if((n = flush(buf, g, i, &out[o])) < 0) {
+			break;
+		} else {
+			o += n;
+		}
+		setup = -1;
+		n = (buf[i] == '[') ? *((int*)&buf[i+1]) : op_size(&buf[i]);
+		memcpy(&out[o], &buf[i], n);
+		o += n;
+		i += n;
+	}
+	if(n >= 0) {
+		if(g->n == 0 && setup >= 0) {
+			memcpy(&out[o], &buf[setup], len - setup);
+			o += len - setup;
+		} else if((n = flush(buf, g, len, &out[o])) >= 0) {
+			o += n;
+		}
+	}
+
+	free(g);
+	if(n < 0) {
+		free(out);
+		return MEMORY_ERR;
+	}
+	*arr = out;
+	return o;
+}
+
+#ifndef __WIN32__
+
+// A loop for one thread of the pool to run
+struct job {
+	char *code; // The loop's code
+	int len;    // The length of code
+	int where;  // The pointer at the loop start
+};
+
+/*** INTERNAL VARIABLES ***/
+// Threads in the pool, besides the calling thread, -1 until it is started
+static int pool_size = -1;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+// The loops of the op being run, the next one to take, and how many are left
+static struct job jobs[MAX_NESTS];
+static int num_jobs = 0, next_job = 0, pending = 0;
+/**************************/
+
+/* Runs loops until none are left to take. Called with pool_lock held.
+ */
+static void take_jobs() {
+	struct job *j;
+	while(next_job < num_jobs) {
+		j = &jobs[next_job++];
+		pthread_mutex_unlock(&pool_lock);
+		where = j->where;
+		execute_from(j->code, j->len, 0);
+		pthread_mutex_lock(&pool_lock);
+		if(--pending == 0) pthread_cond_signal(&work_done);
+	}
+}
+
+/* A thread of the pool, runs loops as they come
+ * @param arg Unused
+ */
+static void* pool_main(void *arg) {
+	pthread_mutex_lock(&pool_lock);
+	while( 1 ) {
+		while(next_job >= num_jobs)
+			pthread_cond_wait(&work_ready, &pool_lock);
+		take_jobs();
+	}
+	return NULL;
+}
+
+/* Starts the pool the first time it is needed
+ * @return The number of threads in the pool (int)
+ */
+static int start_pool() {
+	pthread_t tid;
+	if(pool_size >= 0) return pool_size;
+	pool_size = 0;
+	for(int k = 1; k < nest_threads(); k++) {
+		if(pthread_create(&tid, NULL, pool_main, NULL) != 0) break;
+		pthread_detach(tid);
+		pool_size++;
+	}
+	return pool_size;
+}
+
+#endif
+
+/* Gets the number of threads loop nests may run on, with the calling thread
+ * @return The number of threads, 1 if nests can't run side by side (int)
+ */
+int nest_threads() {
+#ifdef __WIN32__
+	return 1;
+#else
+	int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(n < 1) n = 1;
+	if(n > MAX_POOL) n = MAX_POOL;
+	return n;
+#endif
+}
+
+/* Runs a run of loop nests side by side
+ * @param next The op's operands
+ * @return The offset to apply to the code pointer
+ */
+int run_nests(char *next) {
+	int size = *((int*)next);
+	int *head = (int*)(next + sizeof(int));
+	int n = head[0], lo = head[1], hi = head[2], end = head[3];
+	char *code = (char*)&head[4 + 2*n];
+	char *orig = code;
+
+	for(int k = 0; k < n; k++)
+		orig += head[5 + 2*k];
+
+	// Off the end of the tape, the original code errors (or wraps) as it should
+	if(where + lo < 0 || where + hi >= BF_ARRAY_SIZE) return orig - next;
+
+#ifdef __WIN32__
+	return orig - next;
+#else
+	int start = where;
+	if(start_pool() == 0) return orig - next;
+
+	// Every cell the loops go near is dirty already, so they never write
+	// the dirty range, and only touch their own cells
+	mark_dirty(start + lo, start + hi);
+
+	pthread_mutex_lock(&pool_lock);
+	for(int k = 0; k < n; k++) {
+		jobs[k].code = code;
+		jobs[k].len = head[5 + 2*k];
+		jobs[k].where = start + head[4 + 2*k];
+		code += jobs[k].len;
+	}
+	num_jobs = pending = n;
+	next_job = 0;
+	pthread_cond_broadcast(&work_ready);
+	take_jobs();
+	while(pending > 0)
+		pthread_cond_wait(&work_done, &pool_lock);
+	num_jobs = 0;
+	pthread_mutex_unlock(&pool_lock);
+
+	where = start + end;
+	return sizeof(int) + size;
+#endif
+}
@@ -0,0 +1,35 @@
+#ifndef SIMPLELANGNEST_H
+#define SIMPLELANGNEST_H
+
+/* Independent loop nests run side by side. A top level loop that has an
+ * inner loop, does no I/O, and ends on the cell it started on, touches a
+ * range of cells that is known before it runs, as do the + - < and > that
+ * set it up. In a run of such loops with only their setup between them,
+ * when those ranges don't overlap, the loops can't see each other's
+ * writes, so they run at once on a pool of threads and the pointer ends
+ * where the last one started. Such a run is replaced by one op:
+ * 		OP_NESTS [int size] [int n] [int lo] [int hi] [int end]
+ * 		         [n pairs of ints, pointer offset and code length] [the n loops' code]
+ * 		         [the original code]
+ * where size covers everything after it, lo and hi are the lowest and
+ * highest cells the run goes near, and end is where the pointer ends, all
+ * from the pointer at the start of the run. Each loop's code, with its
+ * setup, has its own fused ops. The original code runs instead when a
+ * cell is off the end of the tape, so errors happen as before.
+ */
+
+#define OP_NESTS   0x13 // Opcode, just after OP_BREAK
+#define MAX_NESTS  64   // Most loops in one op
+#define MAX_POOL   16   // Most threads running loops, with the calling thread
+
+// Largest op header, in front of the loops' code
+#define MAX_NESTS_HEADER (1 + sizeof(int) + 4*sizeof(int) + MAX_NESTS*2*sizeof(int))
+
+// variables defined in SimpleLangnest.c
+extern int par_nests;
+
+int nest_threads();
+int parallel_nests(char*, int, char**);
+int run_nests(char*);
+
+#endif // SIMPLELANGNEST_H
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef __WIN32__
+	#include <pthread.h>
+	#include <unistd.h> //sysconf
+#endif
+
+#include "SimpleLang.h"
+#include "SimpleLangparse.h"
+
+/*** EXTERNAL VARIABLES ***/
+// Number of threads used to parse large sources, 0 to use one per CPU
+int parse_threads = 0;
+// Position in the source of the bracket that caused the last parse error
+long parse_errpos = -1;
+/**************************/
+
+#define MAX_PARSE_THREADS 64 // Upper limit on chunks, whatever the CPU count
+
+// One slice of the source and everything known about it
+struct chunk {
+	char *src;           // The whole source
+	long start, end;     // The slice of src this chunk covers
+	char *out;           // The whole output array
+	int out_pos;         // Where this chunk's output starts
+	int out_len;         // Bytes of output this chunk produces
+	int net;             // Loop depth at the end, relative to the start
+	int min_depth;       // Lowest relative depth after any ]
+	int max_depth;       // Highest relative depth after any [
+	int nclose;          // Number of ] matched in earlier chunks
+	int nopen;           // Number of [ matched in later chunks
+	int close[MAX_LOOPS];// Output positions of those ]
+	int open[MAX_LOOPS]; // Output positions of those [
+};
+
+/* Links a [ to its ], the same way parse() does
+ * @param out The output array
+ * @param open The position of the [
+ * @param close The position of the ]
+ */
+static void link_loop(char *out, int open, int close) {
+	*((int*)&out[close+1]) = open-close;
+	*((int*)&out[open+1]) = close+1+sizeof(int)-open;
+}
+
+/* First pass over a chunk: output size and how loop depth moves
+ * @param arg The chunk (struct chunk*)
+ */
+static void* scan_chunk(void *arg) {
+	struct chunk *c = arg;
+	int depth = 0;
+
+	c->out_len = c->min_depth = c->max_depth = 0;
+	for(long i = c->start; i < c->end; i++) {
+		c->out_len += ir_size(c->src[i]);
+		if(c->src[i] == '[') {
+			if(++depth > c->max_depth) c->max_depth = depth;
+		} else if(c->src[i] == ']') {
+			if(--depth < c->min_depth) c->min_depth = depth;
+		}
+	}
+	c->net = depth;
+	return NULL;
+}
+
+/* Second pass over a chunk: writes the ops and links the loops that open
+ * and close inside it. Loops that cross the chunk's edges are left to
+ * parse_parallel(). Only run once brackets are known to be valid.
+ * @param arg The chunk (struct chunk*)
+ */
+static void* emit_chunk(void *arg) {
+	struct chunk *c = arg;
+	char *ptr = c->out;
+	int cnt = c->out_pos;
+	int depth = 0, loopstack[MAX_LOOPS];
+
+	c->nclose = 0;
+	for(long i = c->start; i < c->end; i++) {
+		switch(c->src[i]) {
+			case '[':
+				ptr[cnt] = '[';
+				loopstack[depth++] = cnt;
+				cnt += 1 + sizeof(int);
+				break;
+			case ']':
+				ptr[cnt] = ']';
+				if(depth > 0)
+					link_loop(ptr, loopstack[--depth], cnt);
+				else
+					c->close[c->nclose++] = cnt;
+				cnt += 1 + sizeof(int);
+				break;
+			default:
+				if(ir_size(c->src[i])) {
+					ptr[cnt] = c->src[i];
+					cnt += 1;
+				}
+				break;
+		}
+	}
+	memcpy(c->open, loopstack, depth * sizeof(int));
+	c->nopen = depth;
+	return NULL;
+}
+
+/* Runs a pass over every chunk, one thread per chunk. The calling thread
+ * takes the first chunk, and any thread that can't be started is run inline.
+ * @param pass The pass to run
+ * @param chunks The chunks
+ * @param n The number of chunks
+ */
+static void run_pass(void* (*pass)(void*), struct chunk *chunks, int n) {
+#ifndef __WIN32__
+	pthread_t tids[MAX_PARSE_THREADS];
+	char started[MAX_PARSE_THREADS] = {0};
+
+	for(int k = 1; k < n; k++)
+		started[k] = (pthread_create(&tids[k], NULL, pass, &chunks[k]) == 0);
+	pass(&chunks[0]);
+	for(int k = 1; k < n; k++) {
+		if(started[k]) pthread_join(tids[k], NULL);
+		else pass(&chunks[k]);
+	}
+#else
+	for(int k = 0; k < n; k++)
+		pass(&chunks[k]);
+#endif
+}
+
+/* Finds the first bracket error in a chunk, given the depth at its start
+ * @param c The chunk
+ * @param depth The loop depth at the start of the chunk
+ * @return BAD_BRACKETS or LOOP_TOO_DEEP, 0 if the chunk is fine (int)
+ */
+static int find_error(struct chunk *c, int depth) {
+	for(long i = c->start; i < c->end; i++) {
+		if(c->src[i] == '[' && ++depth == MAX_LOOPS) {
+			parse_errpos = i;
+			return LOOP_TOO_DEEP;
+		} else if(c->src[i] == ']' && --depth < 0) {
+			parse_errpos = i;
+			return BAD_BRACKETS;
+		}
+	}
+	return 0;
+}
+
+/* Parses a large source the same way as parse(), split over several threads.
+ * Each thread sizes its chunk and tracks loop depth, a prefix sum over the
+ * chunks gives every chunk its output position and starting depth, then each
+ * thread writes its chunk. Loops that cross chunks are linked at the end by
+ * walking the unmatched brackets of each chunk in order.
+ * @param bf The SimpleLang code to parse
+ * @param len The length of bf
+ * @param arr Pointer to the location to store the modified
+ *				code (if NULL will be created using malloc)
+ * @return The length of the newly parsed array, or an error code
+ */
+int parse_parallel(char *bf, long len, char **arr) {
+	struct chunk *chunks;
+	int n = parse_threads, depth = 0, total = 0, err = 0;
+	int sp = 0, loopstack[MAX_LOOPS];
+
+#ifndef __WIN32__
+	if(n <= 0) n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if(n < 1) n = 1;
+	if(n > MAX_PARSE_THREADS) n = MAX_PARSE_THREADS;
+
+	chunks = malloc(n * sizeof(struct chunk));
+	if(chunks == NULL) return MEMORY_ERR;
+
+	for(int k = 0; k < n; k++) {
+		chunks[k].src = bf;
+		chunks[k].start = len * k / n;
+		chunks[k].end = len * (k+1) / n;
+	}
+	run_pass(scan_chunk, chunks, n);
+
+	// Prefix sums give output positions and starting depths. The first chunk
+	// whose depth leaves [0, MAX_LOOPS) holds the same error parse() finds.
+	for(int k = 0; k < n; k++) {
+		if(depth + chunks[k].min_depth < 0 || depth + chunks[k].max_depth >= MAX_LOOPS) {
+			err = find_error(&chunks[k], depth);
+			break;
+		}
+		chunks[k].out_pos = total;
+		total += chunks[k].out_len;
+		depth += chunks[k].net;
+	}
+	if(!err && depth > 0) {
+		// The innermost unclosed loop is the last [ with nothing to close it
+		int need = 0;
+		for(long i = len-1; i >= 0; i--) {
+			if(bf[i] == ']') {
+				need++;
+			} else if(bf[i] == '[' && need-- == 0) {
+				parse_errpos = i;
+				break;
+			}
+		}
+		err = BAD_BRACKETS;
+	}
+	if(err) {
+		free(chunks);
+		return err;
+	}
+
+	// Check if an array was provided, every byte of it is written below
+	if(*arr == NULL) {
+		*arr = malloc(total);
+		if(*arr == NULL) {
+			free(chunks);
+			return MEMORY_ERR;
+		}
+	}
+	for(int k = 0; k < n; k++)
+		chunks[k].out = *arr;
+	run_pass(emit_chunk, chunks, n);
+
+	// Link loops that cross chunks, depth never passes MAX_LOOPS here
+	for(int k = 0; k < n; k++) {
+		for(int j = 0; j < chunks[k].nclose; j++)
+			link_loop(*arr, loopstack[--sp], chunks[k].close[j]);
+		for(int j = 0; j < chunks[k].nopen; j++)
+			loopstack[sp++] = chunks[k].open[j];
+	}
+
+	free(chunks);
+	return total;
+}
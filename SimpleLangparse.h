@@ -0,0 +1,13 @@
+#ifndef SIMPLELANGPARSE_H
+#define SIMPLELANGPARSE_H
+
+// Sources at least this long are parsed on several threads
+#define PAR_PARSE_MIN (1L << 20)
+
+// variables defined in SimpleLangparse.c
+extern int parse_threads;
+extern long parse_errpos;
+
+int parse_parallel(char*, long, char**);
+
+#endif // SIMPLELANGPARSE_H
@@ -5,9 +5,18 @@
 #else
 	#include <sys/socket.h>
 	#include <arpa/inet.h> //inet_addr
-	#include <netdb.h> //gethostbyname
+	#include <netdb.h> //getaddrinfo
 	#include <netinet/in.h> //sockaddr_in
 	#include <unistd.h> //close
+	#include <sys/stat.h> //fstat
+	#include <poll.h> //poll
+	#include <fcntl.h> //O_NONBLOCK
+	#include <errno.h> //EINPROGRESS
+#endif
+#ifdef __linux__
+	#include <sys/sendfile.h> //sendfile
+#endif
+#ifndef __WIN32__
 
 	/* Redefine *nix socket stuff so that Windows code works too */
 	typedef struct sockaddr_in  SOCKADDR_IN;
@@ -16,9 +25,196 @@
 	typedef struct sockaddr*    LPSOCKADDR;
 #endif
 
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
 #include "SimpleLangpp.h"
+#include "SimpleLangstats.h"
+#include "SimpleLangprobe.h"
+
+// A cached host lookup
+struct dns_entry {
+	char host[MAX_HOST];
+	struct in_addr addr;
+	time_t expires; // 0 if the slot is empty
+};
+
+// An idle connection kept by --keep-alive
+struct idle {
+	SOCKET s;
+	char host[MAX_HOST];
+	int port;
+};
+
+/*** EXTERNAL VARIABLES ***/
+// Time allowed for connect() in ms, 0 waits as long as the OS does
+int connect_timeout = CONNECT_TIMEOUT;
+// Connection reuse control variable, if set % keeps closed client connections open
+int keep_alive = 0;
+/**************************/
+
+/*** INTERNAL VARIABLES ***/
+// Host lookups, replaced oldest first
+static struct dns_entry dns_cache[DNS_CACHE_SIZE];
+static int dns_next = 0;
+// Idle client connections
+static struct idle pool[POOL_SIZE];
+static int pool_len = 0;
+// The open client connection, and where it goes
+static SOCKET client = INVALID_SOCKET;
+static char client_host[MAX_HOST];
+static int client_port;
+/**************************/
+
+/* Looks up a host's IPv4 address, using the cache if the lookup is fresh
+ * @param hostname The URL or IP of the host
+ * @param addr Where to store the address
+ * @return 0 if everything went well, -1 otherwise (int)
+ */
+static int resolve(char *hostname, struct in_addr *addr) {
+	struct addrinfo hints, *res;
+	struct dns_entry *e;
+	time_t now = time(NULL);
+	int ret;
+
+	for(int k = 0; k < DNS_CACHE_SIZE; k++) {
+		e = &dns_cache[k];
+		if(e->expires > now && strcmp(e->host, hostname) == 0) {
+			*addr = e->addr;
+			return 0;
+		}
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET; // Servers only listen on IPv4
+	hints.ai_socktype = SOCK_STREAM;
+	IO_TIME(IO_DNS, ret = getaddrinfo(hostname, NULL, &hints, &res));
+	if(ret != 0) return -1;
+	*addr = ((SOCKADDR_IN*)res->ai_addr)->sin_addr;
+	freeaddrinfo(res);
+
+	if(strlen(hostname) < MAX_HOST) {
+		e = &dns_cache[dns_next];
+		dns_next = (dns_next + 1) % DNS_CACHE_SIZE;
+		strcpy(e->host, hostname);
+		e->addr = *addr;
+		e->expires = now + DNS_TTL;
+	}
+	return 0;
+}
+
+/* Switches a socket between blocking and non-blocking mode
+ * @param s The socket
+ * @param on 1 for blocking, 0 for non-blocking
+ */
+static void set_blocking(SOCKET s, int on) {
+#ifdef __WIN32__
+	u_long mode = !on;
+	ioctlsocket(s, FIONBIO, &mode);
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	fcntl(s, F_SETFL, on ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+#endif
+}
+
+/* Starts a non-blocking connect and waits for it, up to connect_timeout
+ * @param s The socket, in non-blocking mode
+ * @param addr The address to connect to
+ * @return 0 if everything went well, SOCKET_ERROR otherwise (int)
+ */
+static int connect_nb(SOCKET s, SOCKADDR_IN *addr) {
+#ifdef __WIN32__
+	struct timeval tv;
+	fd_set wr, ex;
+#else
+	struct pollfd pfd = { s, POLLOUT, 0 };
+#endif
+	socklen_t len = sizeof(int);
+	int err = 0;
+
+	if(connect(s, (LPSOCKADDR)addr, sizeof(*addr)) != SOCKET_ERROR) return 0;
+#ifdef __WIN32__
+	if(WSAGetLastError() != WSAEWOULDBLOCK) return SOCKET_ERROR;
+#else
+	if(errno != EINPROGRESS) return SOCKET_ERROR;
+#endif
+
+	// Wait for the handshake, a failure shows as writable (or an exception on Windows).
+	// A Windows fd_set lists sockets, elsewhere poll() takes fds past FD_SETSIZE.
+#ifdef __WIN32__
+	FD_ZERO(&wr);
+	FD_SET(s, &wr);
+	FD_ZERO(&ex);
+	FD_SET(s, &ex);
+	tv.tv_sec = connect_timeout / 1000;
+	tv.tv_usec = (connect_timeout % 1000) * 1000;
+	if(select(s+1, NULL, &wr, &ex, &tv) <= 0) return SOCKET_ERROR; // Timed out
+#else
+	if(poll(&pfd, 1, connect_timeout) <= 0) return SOCKET_ERROR; // Timed out
+#endif
+	if(getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&err, &len) != 0 || err != 0)
+		return SOCKET_ERROR;
+	return 0;
+}
+
+/* Connects a socket, giving up after connect_timeout
+ * @param s The socket
+ * @param addr The address to connect to
+ * @return 0 if everything went well, -1 otherwise (int)
+ */
+static int connect_wait(SOCKET s, SOCKADDR_IN *addr) {
+	int ret;
+
+	if(connect_timeout <= 0) {
+		IO_TIME(IO_CONNECT, ret = connect(s, (LPSOCKADDR)addr, sizeof(*addr)));
+	} else {
+		set_blocking(s, 0);
+		IO_TIME(IO_CONNECT, ret = connect_nb(s, addr));
+		set_blocking(s, 1);
+	}
+	return (ret == SOCKET_ERROR) ? -1 : 0;
+}
+
+/* Takes an idle connection to a host and port out of the pool. Connections
+ * the other end closed, or sent data on while idle, are thrown away.
+ * @param hostname The URL or IP of the host
+ * @param portno The port
+ * @return The connection, or INVALID_SOCKET if there is none (SOCKET)
+ */
+static SOCKET take_idle(char *hostname, int portno) {
+#ifdef __WIN32__
+	struct timeval tv = {0, 0};
+	fd_set rd;
+#else
+	struct pollfd pfd;
+#endif
+	SOCKET s;
+
+	for(int k = 0; k < pool_len; k++) {
+		if(pool[k].port != portno || strcmp(pool[k].host, hostname) != 0) continue;
+		s = pool[k].s;
+		pool[k] = pool[--pool_len];
 
-/* Opens a socket and connects to a given host on a given port
+#ifdef __WIN32__
+		FD_ZERO(&rd);
+		FD_SET(s, &rd);
+		if(select(s+1, &rd, NULL, NULL, &tv) == 0) return s; // Nothing waiting, still up
+#else
+		pfd.fd = s;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if(poll(&pfd, 1, 0) == 0) return s; // Nothing waiting, still up
+#endif
+		close_sock(s);
+		k--; // The last entry moved here
+	}
+	return INVALID_SOCKET;
+}
+
+/* Opens a socket and connects to a given host on a given port. Lookups
+ * are cached, connect gives up after connect_timeout, and with
+ * --keep-alive an idle connection to the same place is reused.
  * NOTE: Winsock code is from http://johnnie.jerrata.com/winsocktutorial/ and has 
  * 		 been modified for portability
  * @param s The socket to open
@@ -27,7 +223,12 @@
  * @return 0 if everything went well, -1 otherwise (char)
  */
 char open_client(SOCKET* s, char* hostname, int portno) {
-	int ret;
+	SOCKADDR_IN serverInfo;
+
+	PROBE(client__connect, hostname, portno);
+	if(keep_alive && (*s = take_idle(hostname, portno)) != INVALID_SOCKET)
+		goto opened;
+
 #ifdef __WIN32__
 	WORD sockVersion;
 	WSADATA wsaData;
@@ -37,16 +238,16 @@ char open_client(SOCKET* s, char* hostname, int portno) {
 	// Initialize Winsock
 	WSAStartup(sockVersion, &wsaData);
 #endif
-	
-	// Store information about the server
-	LPHOSTENT hostEntry;
-	
-	// Specifying the server by its name;
-	if (!(hostEntry = gethostbyname(hostname)))
-	{
+
+	// Fill a SOCKADDR_IN struct with address information
+	memset(&serverInfo, 0, sizeof(serverInfo));
+	serverInfo.sin_family = AF_INET;
+	serverInfo.sin_port = htons(portno);
+	if(resolve(hostname, &serverInfo.sin_addr) != 0) {
 #ifdef __WIN32__
 		WSACleanup();
 #endif
+		*s = INVALID_SOCKET;
 		return -1;
 	}
 
@@ -62,25 +263,20 @@ char open_client(SOCKET* s, char* hostname, int portno) {
 #endif
 		return -1;
 	}
-	
-	// Fill a SOCKADDR_IN struct with address information
-	SOCKADDR_IN serverInfo;
-	serverInfo.sin_family = AF_INET;
-
-	// Change to network-byte order and
-	// insert into port field
-	serverInfo.sin_addr = *((LPIN_ADDR)*hostEntry->h_addr_list);
-	serverInfo.sin_port = htons(portno);
 
-	ret = connect(*s, (LPSOCKADDR)&serverInfo, sizeof(struct sockaddr));
-	if(ret == SOCKET_ERROR)
+	if(connect_wait(*s, &serverInfo) != 0)
 	{
-#ifdef __WIN32__
-		WSACleanup();
-#endif
+		close_sock(*s);
+		*s = INVALID_SOCKET;
 		return -1;
 	}
 
+opened:
+	PROBE(client__open, hostname, portno, (int)*s);
+	client = *s;
+	client_port = portno;
+	strncpy(client_host, hostname, MAX_HOST-1);
+	client_host[MAX_HOST-1] = '\0';
 	return 0;
 }
 
@@ -105,6 +301,7 @@ char open_server(SOCKET* s, SOCKET* c, int portno) {
 #endif
 	int ret; // For storing return values
 	
+	PROBE(server__listen, portno);
 	*s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 	if (*s == INVALID_SOCKET) {
 #ifdef __WIN32__
@@ -152,7 +349,7 @@ char open_server(SOCKET* s, SOCKET* c, int portno) {
     struct sockaddr_storage their_addr;
 	socklen_t addr_size = sizeof their_addr;
 
-	*c = accept(*s, (struct sockaddr *)&their_addr, &addr_size);
+	IO_TIME(IO_ACCEPT, *c = accept(*s, (struct sockaddr *)&their_addr, &addr_size));
 	if(*c == INVALID_SOCKET) {
 #ifdef __WIN32__
 		WSACleanup();
@@ -160,6 +357,7 @@ char open_server(SOCKET* s, SOCKET* c, int portno) {
 		return -1;
 	}
 	
+	PROBE(server__accept, portno, (int)*c);
 	return 0;
 }
 
@@ -177,12 +375,36 @@ void close_sock(SOCKET s) {
 	}
 }
 
+/* Closes a connection made by open_client. With --keep-alive it is kept
+ * for the next open_client to the same host and port instead.
+ * @param s The socket to close
+ */
+void close_client(SOCKET s) {
+	if(keep_alive && s == client && s != INVALID_SOCKET && pool_len < POOL_SIZE
+			&& strlen(client_host) < MAX_HOST-1) {
+		pool[pool_len].s = s;
+		pool[pool_len].port = client_port;
+		strcpy(pool[pool_len].host, client_host);
+		pool_len++;
+	} else {
+		close_sock(s);
+	}
+	client = INVALID_SOCKET;
+}
+
+/* Closes every idle connection kept by --keep-alive
+ */
+void close_pool() {
+	while(pool_len > 0)
+		close_sock(pool[--pool_len].s);
+}
+
 /* Sends a single byte from an open socket
  * @param s The socket to write to 
  * @param byte The data to send
  */
 void send_sock(SOCKET s, char byte) {
-	send(s, &byte, 1, 0);
+	IO_TIME(IO_SOCK, send(s, &byte, 1, 0));
 }
 
 /* Recieves and returns a single byte from an open socket
@@ -191,7 +413,81 @@ void send_sock(SOCKET s, char byte) {
  */
 char recv_sock(SOCKET s) {
 	char byte;
-	recv(s, &byte, 1, 0);
+	IO_TIME(IO_SOCK, recv(s, &byte, 1, 0));
 	return byte;
 }
 
+
+/* Sends a block of bytes through an open socket
+ * @param s The socket to write to
+ * @param data The data to send
+ * @param len The number of bytes to send
+ * @return The number of bytes sent (int)
+ */
+int send_sock_n(SOCKET s, char *data, int len) {
+	int ret, sent = 0;
+	while(sent < len) {
+		IO_TIME(IO_SOCK, ret = send(s, data+sent, len-sent, 0));
+		if(ret <= 0) break;
+		sent += ret;
+	}
+	return sent;
+}
+
+/* Recieves up to len bytes from an open socket, blocking until some arrive
+ * @param s The socket to read from
+ * @param data Where to store the data
+ * @param len The maximum number of bytes to read
+ * @return The number of bytes recieved, 0 if the connection was closed (int)
+ */
+int recv_sock_n(SOCKET s, char *data, int len) {
+	int ret;
+	IO_TIME(IO_SOCK, ret = recv(s, data, len, 0));
+	return ret < 0 ? 0 : ret;
+}
+
+/* Sends bytes from a file through an open socket, starting at the file's
+ * current position. On Linux the data goes through sendfile() and never
+ * leaves the kernel, elsewhere it is copied through a small buffer.
+ * The file position is advanced past the bytes that were sent.
+ * @param s The socket to write to
+ * @param fp The file to read from
+ * @param len The number of bytes to send, or 0 to send the rest of the file
+ * @return The number of bytes sent (long)
+ */
+long send_file(SOCKET s, FILE *fp, long len) {
+	long off, sent = 0;
+	if(fflush(fp) != 0 || (off = ftell(fp)) < 0)
+		return 0;
+#ifdef __linux__
+	struct stat st;
+	ssize_t ret;
+	if(len == 0) {
+		if(fstat(fileno(fp), &st) != 0 || st.st_size <= off)
+			return 0;
+		len = st.st_size - off;
+	}
+	// sendfile() takes the offset explicitly, so the stream buffer is skipped
+	while(sent < len) {
+		IO_TIME(IO_SOCK, ret = sendfile(s, fileno(fp), &off, len-sent));
+		if(ret <= 0) break;
+		sent += ret;
+	}
+	fseek(fp, off, SEEK_SET); // Drop stale buffered data and move past what we sent
+#else
+	char buf[NUM_BYTES];
+	int n, ret;
+	while(len == 0 || sent < len) {
+		n = (len == 0 || len-sent > NUM_BYTES) ? NUM_BYTES : (int)(len-sent);
+		IO_TIME(IO_FILE, n = fread(buf, 1, n, fp));
+		if(n <= 0) break;
+		ret = send_sock_n(s, buf, n);
+		sent += ret;
+		if(ret < n) {
+			fseek(fp, off+sent, SEEK_SET); // Leave the file at the first unsent byte
+			break;
+		}
+	}
+#endif
+	return sent;
+}
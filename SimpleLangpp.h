@@ -12,14 +12,32 @@
 	typedef int SOCKET;
 #endif
 
+#include <stdio.h> // FILE
+
 #define BF_ARRAY_SIZE 32768 // 2^15 bytes usable data space
 #define NUM_BYTES	  1024  // Read up to 1024 bytes at a time in the console
 
+// Client connections
+#define CONNECT_TIMEOUT 10000 // Default connect timeout in ms, 0 waits forever
+#define DNS_CACHE_SIZE  16    // Host lookups kept
+#define DNS_TTL         60    // Seconds a kept lookup is used for
+#define POOL_SIZE       8     // Idle connections kept by --keep-alive
+#define MAX_HOST        256   // Longest host name that is cached or pooled
+
+// variables defined in SimpleLangpp.c
+extern int connect_timeout;
+extern int keep_alive;
+
 char open_client(SOCKET*, char*, int);
 char open_server(SOCKET*, SOCKET*, int);
 void close_sock(SOCKET);
+void close_client(SOCKET);
+void close_pool();
 void send_sock(SOCKET, char);
 char recv_sock(SOCKET);
+int send_sock_n(SOCKET, char*, int);
+int recv_sock_n(SOCKET, char*, int);
+long send_file(SOCKET, FILE*, long);
 
 
 #endif // SIMPLELANGPP_H
@@ -0,0 +1,61 @@
+#ifndef SIMPLELANGPROBE_H
+#define SIMPLELANGPROBE_H
+
+/* Static tracepoints (USDT), provider simplelang. When <sys/sdt.h> is
+ * found (systemtap-sdt-dev on Debian, systemtap-sdt-devel on Fedora), each
+ * probe is one nop in the code plus a note that perf, bpftrace and
+ * SystemTap read, so probes cost nothing until a tracer attaches, e.g.
+ * 		bpftrace -e 'usdt:./SimpleLang:simplelang:runtime__error { @[arg0] = count(); }'
+ * Without it, or with -DNO_PROBES, the probes are left out.
+ *
+ * 		parse__done     (int len, long ns)
+ * 			Program parsed, len bytes (an op is 1, [ and ] are 5)
+ * 		parse__error    (int err, long pos)
+ * 			Bad brackets or loops too deep, at pos in the source
+ * 		loop__enter     (char *op, int where)
+ * 			A [ starts a pass of its loop
+ * 		loop__exit      (char *op, int where)
+ * 			A [ finds its cell is 0
+ * 		file__open      (char *name, int ok)
+ * 			# opened a file, ok is 0 if it failed
+ * 		socket__open    (char *host, int port, int ret)
+ * 			% opened a socket, host is "" for a server
+ * 		client__connect (char *host, int port)
+ * 			open_client() starts
+ * 		client__open    (char *host, int port, int fd)
+ * 			open_client() has a connection
+ * 		server__listen  (int port)
+ * 			open_server() starts
+ * 		server__accept  (int port, int fd)
+ * 			open_server() has a client
+ * 		runtime__error  (int err, int pos, int op)
+ * 			A program stops with an error
+ *
+ * op in the loop probes is the loop's place in the compiled code, the same
+ * for every pass. Loops fused into other ops or swapped for their closed
+ * form don't fire the loop probes, run with --no-superops --no-closed-loops
+ * to see every loop.
+ */
+
+#if !defined(NO_PROBES) && defined(__has_include)
+	#if __has_include(<sys/sdt.h>)
+		#define HAVE_PROBES
+	#endif
+#endif
+
+#ifdef HAVE_PROBES
+	#include <sys/sdt.h>
+
+	#define PROBE(name, ...) STAP_PROBEV(simplelang, name, __VA_ARGS__)
+	// Clock for probe arguments, only read when probes are built in
+	#define PROBE_CLOCK() now_ns()
+#else
+	/* Stands in for a probe, so its arguments still count as used
+	 */
+	static inline void no_probe(int unused, ...) {}
+
+	#define PROBE(name, ...) do { if(0) no_probe(0, __VA_ARGS__); } while(0)
+	#define PROBE_CLOCK() 0ULL
+#endif
+
+#endif // SIMPLELANGPROBE_H
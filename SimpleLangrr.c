@@ -0,0 +1,180 @@
+/* Deterministic record/replay of program input
+ *
+ * --record FILE runs a program normally and logs the result of every input
+ * op. --replay FILE runs it again from the log, so programs that talk to
+ * files and sockets can be timed without the peer on the other end. The
+ * replay log is read into memory up front to keep disk reads out of timings.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "SimpleLang.h"
+#include "SimpleLangrr.h"
+
+/*** EXTERNAL VARIABLES ***/
+// Record/replay mode (RR_OFF, RR_RECORD or RR_REPLAY)
+int rr_mode = RR_OFF;
+/**************************/
+
+/*** INTERNAL VARIABLES ***/
+// Log being recorded
+static FILE *rr_fp = NULL;
+// Log being replayed, and the read position in it
+static unsigned char *rr_log = NULL;
+static long rr_len = 0, rr_pos = 0;
+/**************************/
+
+/* Opens a log for recording or replaying
+ * @param fname The log file
+ * @param mode RR_RECORD or RR_REPLAY
+ * @return 0 if everything went well, 1 otherwise (int)
+ */
+int rr_open(char *fname, int mode) {
+	FILE *fp;
+
+	if(mode == RR_RECORD) {
+		rr_fp = fopen(fname, "wb");
+		if(rr_fp == NULL) {
+			fprintf(stderr, "Error opening file '%s' for recording.\n", fname);
+			return 1;
+		}
+		fwrite(RR_MAGIC, 1, 4, rr_fp);
+	} else {
+		fp = fopen(fname, "rb");
+		if(fp == NULL) {
+			fprintf(stderr, "Error opening file '%s' for replay.\n", fname);
+			return 1;
+		}
+		fseek(fp, 0, SEEK_END);
+		rr_len = ftell(fp);
+		rewind(fp);
+		rr_log = malloc(rr_len > 0 ? rr_len : 1);
+		if(rr_log == NULL || fread(rr_log, 1, rr_len, fp) != rr_len
+				|| rr_len < 4 || memcmp(rr_log, RR_MAGIC, 4) != 0) {
+			fprintf(stderr, "Error: '%s' is not a recording.\n", fname);
+			fclose(fp);
+			free(rr_log);
+			rr_log = NULL;
+			return 1;
+		}
+		fclose(fp);
+		rr_pos = 4;
+	}
+	rr_mode = mode;
+	return 0;
+}
+
+/* Closes the log, flushing a recording to disk
+ */
+void rr_close() {
+	if(rr_fp != NULL) {
+		fclose(rr_fp);
+		rr_fp = NULL;
+	}
+	free(rr_log);
+	rr_log = NULL;
+	rr_mode = RR_OFF;
+}
+
+/* Gets the cells an input op wrote, once it has run
+ * @param op The operation
+ * @param at The pointer when the op ran
+ * @param len Where to store the number of cells
+ * @return The first cell (int)
+ */
+int rr_span(char op, int at, int *len) {
+	switch(op) {
+		case ',': case '#': case '@': case '$':
+		case ':': case '%': case '!':
+			*len = 1;
+			return at;
+		case '{': // Length and the data read
+			*len = (at+3 > BF_ARRAY_SIZE) ? 0 : 2 + (int)get_be(at+1, 2);
+			return at+1;
+		case '}': // Length written
+			*len = (at+3 > BF_ARRAY_SIZE) ? 0 : 2;
+			return at+1;
+		case '&': // Bytes sent
+			*len = 4;
+			return at;
+		default:
+			*len = 0;
+			return at;
+	}
+}
+
+/* Writes a 4 byte big endian number to the recording
+ * @param val The number
+ */
+static void put_be32(unsigned long val) {
+	putc((val >> 24) & 0xff, rr_fp);
+	putc((val >> 16) & 0xff, rr_fp);
+	putc((val >> 8) & 0xff, rr_fp);
+	putc(val & 0xff, rr_fp);
+}
+
+/* Reads a 4 byte big endian number from the replay log
+ * @return The number (unsigned long)
+ */
+static unsigned long get_be32() {
+	unsigned char *p = &rr_log[rr_pos];
+	rr_pos += 4;
+	return ((unsigned long)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* Logs the result of an input op, call after the op has run
+ * @param op The operation
+ * @param at The pointer when the op ran
+ */
+void rr_record(char op, int at) {
+	int first, len = 0;
+
+	first = rr_span(op, at, &len);
+	if(where != at) len = 0; // The op failed, nothing was written
+	putc(op, rr_fp);
+	put_be32((unsigned long)where);
+	put_be32((unsigned long)len);
+	fwrite(&memory[first], 1, len, rr_fp);
+}
+
+/* Runs an input op from the replay log, in place of the real op.
+ * Output to stdout from } still happens, everything else is logged.
+ * @param op The operation
+ * @param at The pointer when the op runs
+ */
+void rr_replay(char op, int at) {
+	int status, first, len, span;
+
+	if(rr_pos + 9 > rr_len || rr_log[rr_pos] != (unsigned char)op) {
+		where = REPLAY_ERR;
+		return;
+	}
+	rr_pos++;
+	status = (int)get_be32();
+	len = (int)get_be32();
+	first = rr_span(op, at, &span); // The log has the recorded length
+	if(len < 0 || len > span || first + len > BF_ARRAY_SIZE || rr_pos + len > rr_len) {
+		where = REPLAY_ERR;
+		return;
+	}
+	if(status != at) { // The op failed when recorded
+		where = status;
+		rr_pos += len;
+		return;
+	}
+
+	if(op == '}' && memory[at] == BLOCK_STDIO) {
+		if(at+3 > BF_ARRAY_SIZE) { where = INDEX_OOB; return; }
+		span = (int)get_be(at+1, 2);
+		if(at+3+span > BF_ARRAY_SIZE) { where = INDEX_OOB; return; }
+		fwrite(&memory[at+3], 1, span, stdout);
+	}
+
+	if(len > 0) {
+		mark_dirty(first, first+len-1);
+		memcpy(&memory[first], &rr_log[rr_pos], len);
+	}
+	rr_pos += len;
+}
@@ -0,0 +1,29 @@
+#ifndef SIMPLELANGRR_H
+#define SIMPLELANGRR_H
+
+/* Record and replay of program input. A recording logs what every input
+ * op (, and the SimpleLang++ ops) put on the tape, and replaying the log
+ * puts the same bytes back without touching stdin, files or sockets.
+ *
+ * The log starts with RR_MAGIC, followed by one record per op:
+ * 		[1 byte op] [4 byte pointer after the op] [4 byte length] [length bytes]
+ * all big endian. The bytes are the cells the op wrote, see rr_span().
+ */
+
+// Modes for rr_mode
+#define RR_OFF    0
+#define RR_RECORD 1
+#define RR_REPLAY 2
+
+#define RR_MAGIC  "BFRR"
+
+// variables defined in SimpleLangrr.c
+extern int rr_mode;
+
+int rr_open(char*, int);
+void rr_close();
+int rr_span(char, int, int*);
+void rr_record(char, int);
+void rr_replay(char, int);
+
+#endif // SIMPLELANGRR_H
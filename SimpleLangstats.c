@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>  //open
+#include <unistd.h> //write
+
+#ifdef __WIN32__
+	#include <windows.h>
+#else
+	#include <signal.h>
+#endif
+#ifdef __linux__
+	#include <linux/perf_event.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+#endif
+
+#include "SimpleLangstats.h"
+
+/*** EXTERNAL VARIABLES ***/
+// Stats control variable (STATS_OFF, STATS_TEXT or STATS_JSON)
+int perf_stats = STATS_OFF;
+// Number of times each op was dispatched
+unsigned long long stat_ops[256] = {0};
+// Number of bytes moved by each I/O op
+unsigned long long stat_bytes[256] = {0};
+// Number of loop bodies entered
+unsigned long long stat_loops = 0;
+// I/O timing control variable, set by io_stats_begin()
+int io_stats = 0;
+// Number of blocking calls of each I/O class
+unsigned long long io_calls[NUM_IO] = {0};
+/**************************/
+
+/*** INTERNAL VARIABLES ***/
+// Names of the hardware counters, in HW_* order
+static const char *hw_names[NUM_HW] = {
+	"cycles", "instructions", "branch-misses", "L1d-read-misses", "LLC-misses"
+};
+// perf_event file descriptors, -1 if the counter is not available
+static int hw_fd[NUM_HW] = {-1, -1, -1, -1, -1};
+// Set once we have tried to open the counters
+static char hw_opened = 0;
+// Wall time spent in run_code, in nanoseconds
+static unsigned long long wall_ns = 0, wall_start;
+// The I/O ops we report bytes for
+static const char io_ops[] = ".,:;^!{}&";
+// Names of the I/O classes, in IO_* order
+static const char *io_names[NUM_IO] = {
+	"stdio", "file", "dns", "connect", "accept", "socket"
+};
+// Time blocked in, and latency histogram of each I/O class
+static unsigned long long io_ns[NUM_IO];
+static unsigned long long io_hist[NUM_IO][IO_BUCKETS];
+// When I/O timing started, and where to dump it
+static unsigned long long io_start;
+static char *io_path = NULL;
+// Buffer the dump is built in, so it can be written from a signal handler
+static char io_buf[16384];
+static int io_len;
+/**************************/
+
+/* Reads a monotonic clock
+ * @return The current time in nanoseconds (unsigned long long)
+ */
+unsigned long long now_ns() {
+#ifdef __WIN32__
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (unsigned long long)(count.QuadPart * (1000000000.0 / freq.QuadPart));
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+#ifdef __linux__
+/* Opens a single hardware counter for this process, disabled until stats_begin()
+ * @param type The perf event type (PERF_TYPE_*)
+ * @param config The event config for that type
+ * @return The counter's file descriptor, or -1 if it is unavailable (int)
+ */
+static int open_counter(unsigned int type, unsigned long long config) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1; // Works with perf_event_paranoid <= 2
+	attr.exclude_hv = 1;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/* Opens the hardware counters the first time stats are taken.
+ * Counters the kernel or CPU does not support are left at -1.
+ */
+static void open_counters() {
+	hw_opened = 1;
+#ifdef __linux__
+	hw_fd[HW_CYCLES]       = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	hw_fd[HW_INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	hw_fd[HW_BRANCH_MISS]  = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+	hw_fd[HW_L1D_MISS]     = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+	                                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	hw_fd[HW_LLC_MISS]     = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+}
+
+/* Starts counting, called when run_code() starts.
+ */
+void stats_begin() {
+	if(!hw_opened) open_counters();
+#ifdef __linux__
+	for(int i = 0; i < NUM_HW; i++) {
+		if(hw_fd[i] >= 0) ioctl(hw_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+	wall_start = now_ns();
+}
+
+/* Stops counting, called when run_code() returns. Counts accumulate
+ * over every call, so the console reports totals for the whole session.
+ */
+void stats_end() {
+#ifdef __linux__
+	for(int i = 0; i < NUM_HW; i++) {
+		if(hw_fd[i] >= 0) ioctl(hw_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+#endif
+	wall_ns += now_ns() - wall_start;
+}
+
+/* Reads a hardware counter
+ * @param i The counter (HW_*)
+ * @param val Where to store the value
+ * @return 1 if the counter is available, 0 otherwise (int)
+ */
+static int read_counter(int i, unsigned long long *val) {
+#ifdef __linux__
+	if(hw_fd[i] >= 0 && read(hw_fd[i], val, sizeof(*val)) == sizeof(*val))
+		return 1;
+#endif
+	return 0;
+}
+
+/* Gets a printable name for an op, control bytes are shown in hex
+ * @param op The op
+ * @param buf At least 5 bytes to build the name in
+ * @return The name (char*)
+ */
+static char* op_name(unsigned char op, char *buf) {
+	if(op >= 0x20 && op < 0x7f && op != '"' && op != '\\')
+		sprintf(buf, "%c", op);
+	else
+		sprintf(buf, "0x%02x", op);
+	return buf;
+}
+
+/* Writes every counter collected so far
+ * @param out The stream to write to (usually stderr, so program output is untouched)
+ */
+void stats_report(FILE *out) {
+	unsigned long long val, total = 0;
+	char name[8];
+	int first;
+
+	for(int i = 0; i < 256; i++) total += stat_ops[i];
+
+	if(perf_stats == STATS_JSON) {
+		fprintf(out, "{\"wall_ns\": %llu, \"hardware\": {", wall_ns);
+		for(int i = 0; i < NUM_HW; i++) {
+			if(read_counter(i, &val))
+				fprintf(out, "%s\"%s\": %llu", i ? ", " : "", hw_names[i], val);
+			else
+				fprintf(out, "%s\"%s\": null", i ? ", " : "", hw_names[i]);
+		}
+		fprintf(out, "}, \"ops_total\": %llu, \"ops\": {", total);
+		first = 1;
+		for(int i = 0; i < 256; i++) {
+			if(stat_ops[i] == 0) continue;
+			fprintf(out, "%s\"%s\": %llu", first ? "" : ", ", op_name(i, name), stat_ops[i]);
+			first = 0;
+		}
+		fprintf(out, "}, \"loop_iterations\": %llu, \"io_bytes\": {", stat_loops);
+		for(int i = 0; io_ops[i]; i++) {
+			fprintf(out, "%s\"%c\": %llu", i ? ", " : "", io_ops[i], stat_bytes[(unsigned char)io_ops[i]]);
+		}
+		fprintf(out, "}}\n");
+		return;
+	}
+
+	fprintf(out, "-------------------------------------------------------------------------------\n");
+	fprintf(out, "                              Performance Stats\n");
+	fprintf(out, "-------------------------------------------------------------------------------\n");
+	fprintf(out, "wall time          %llu ns\n", wall_ns);
+	for(int i = 0; i < NUM_HW; i++) {
+		if(read_counter(i, &val))
+			fprintf(out, "%-18s %llu\n", hw_names[i], val);
+		else
+			fprintf(out, "%-18s not supported\n", hw_names[i]);
+	}
+	fprintf(out, "ops dispatched     %llu\n", total);
+	for(int i = 0; i < 256; i++) {
+		if(stat_ops[i] == 0) continue;
+		fprintf(out, "   %-6s          %llu (%.1f%%)\n", op_name(i, name), stat_ops[i], 100.0*stat_ops[i]/total);
+	}
+	fprintf(out, "loop iterations    %llu\n", stat_loops);
+	fprintf(out, "bytes moved\n");
+	for(int i = 0; io_ops[i]; i++) {
+		fprintf(out, "   %c               %llu\n", io_ops[i], stat_bytes[(unsigned char)io_ops[i]]);
+	}
+}
+
+/* Adds one blocking call to the I/O stats
+ * @param cls The class of call (IO_*)
+ * @param ns The time it took
+ */
+void io_add(int cls, unsigned long long ns) {
+	int b = 0;
+	io_ns[cls] += ns;
+	io_calls[cls]++;
+	while(ns > 1 && b < IO_BUCKETS-1) {
+		ns >>= 1;
+		b++;
+	}
+	io_hist[cls][b]++;
+}
+
+/* Appends a string to the dump buffer
+ * @param str The string
+ */
+static void io_put(const char *str) {
+	while(*str && io_len < (int)sizeof(io_buf))
+		io_buf[io_len++] = *str++;
+}
+
+/* Appends a number to the dump buffer, printf is not safe in a signal handler
+ * @param val The number
+ * @param width Pad on the left with spaces to this many characters
+ */
+static void io_put_num(unsigned long long val, int width) {
+	char digits[24];
+	int n = 0;
+	do {
+		digits[n++] = '0' + val % 10;
+		val /= 10;
+	} while(val > 0);
+	for(; width > n; width--) io_put(" ");
+	while(n > 0 && io_len < (int)sizeof(io_buf))
+		io_buf[io_len++] = digits[--n];
+}
+
+/* Writes the I/O stats to the --io-stats file, replacing what was there.
+ * Only uses async-signal-safe calls, so it also runs on SIGUSR1.
+ */
+void io_stats_dump() {
+	unsigned long long wall, blocked = 0;
+	int fd;
+
+	if(io_path == NULL) return;
+	wall = now_ns() - io_start;
+	for(int i = 0; i < NUM_IO; i++) blocked += io_ns[i];
+
+	io_len = 0;
+	io_put("wall      ");
+	io_put_num(wall, 16);
+	io_put(" ns\ncompute   ");
+	io_put_num(wall > blocked ? wall - blocked : 0, 16);
+	io_put(" ns\n");
+	for(int i = 0; i < NUM_IO; i++) {
+		io_put(io_names[i]);
+		for(int k = strlen(io_names[i]); k < 10; k++) io_put(" ");
+		io_put_num(io_ns[i], 16);
+		io_put(" ns in ");
+		io_put_num(io_calls[i], 0);
+		io_put(" calls\n");
+	}
+	for(int i = 0; i < NUM_IO; i++) {
+		if(io_calls[i] == 0) continue;
+		io_put("\nlatency of ");
+		io_put(io_names[i]);
+		io_put(" (ns, calls)\n");
+		for(int b = 0; b < IO_BUCKETS; b++) {
+			if(io_hist[i][b] == 0) continue;
+			io_put("  >= ");
+			io_put_num(b ? 1ULL << b : 0, 14);
+			io_put_num(io_hist[i][b], 12);
+			io_put("\n");
+		}
+	}
+
+	fd = open(io_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) return;
+	if(write(fd, io_buf, io_len) < 0) {} // Nothing more can be done from a handler
+	close(fd);
+}
+
+#ifndef __WIN32__
+/* Dumps the I/O stats on SIGUSR1, so a running server can be checked
+ * @param sig The signal number
+ */
+static void io_signal(int sig) {
+	io_stats_dump();
+}
+#endif
+
+/* Starts timing blocking calls, dumped to a file at exit and on SIGUSR1
+ * @param path The file to dump to
+ * @return 0 if everything went well, 1 otherwise (int)
+ */
+int io_stats_begin(char *path) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		fprintf(stderr, "Error opening file '%s' for I/O stats.\n", path);
+		return 1;
+	}
+	close(fd);
+	io_path = path;
+	io_stats = 1;
+	io_start = now_ns();
+#ifndef __WIN32__
+	signal(SIGUSR1, io_signal);
+#endif
+	return 0;
+}
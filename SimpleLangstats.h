@@ -0,0 +1,59 @@
+#ifndef SIMPLELANGSTATS_H
+#define SIMPLELANGSTATS_H
+
+#include <stdio.h> // FILE
+
+// Output formats for --perf-stats
+#define STATS_OFF  0
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+// Hardware counters read through perf_event_open (Linux only)
+#define HW_CYCLES       0
+#define HW_INSTRUCTIONS 1
+#define HW_BRANCH_MISS  2
+#define HW_L1D_MISS     3
+#define HW_LLC_MISS     4
+#define NUM_HW          5
+
+// Classes of blocking calls timed by --io-stats
+#define IO_STDIO   0 // getchar, printf and block I/O on stdin/stdout
+#define IO_FILE    1 // fopen, fclose, getc, putc, fread, fwrite and fseek
+#define IO_DNS     2 // getaddrinfo in open_client
+#define IO_CONNECT 3 // connect in open_client
+#define IO_ACCEPT  4 // accept in open_server, includes waiting for the client
+#define IO_SOCK    5 // send, recv and sendfile
+#define NUM_IO     6
+#define IO_BUCKETS 40 // Latency histogram buckets, bucket b counts calls of 2^b to 2^(b+1) ns
+
+// variables defined in SimpleLangstats.c
+extern int perf_stats;
+extern unsigned long long stat_ops[256];
+extern unsigned long long stat_bytes[256];
+extern unsigned long long stat_loops;
+extern int io_stats;
+extern unsigned long long io_calls[NUM_IO];
+
+// Counts n bytes moved by an I/O op, only when stats are enabled
+#define STAT_BYTES(op, n) do { if(perf_stats) stat_bytes[(unsigned char)(op)] += (n); } while(0)
+
+// Runs stmt, adding the time it blocks for to class cls when I/O stats are on
+#define IO_TIME(cls, ...) do { \
+	if(io_stats) { \
+		unsigned long long io_t0_ = now_ns(); \
+		__VA_ARGS__; \
+		io_add(cls, now_ns() - io_t0_); \
+	} else { \
+		__VA_ARGS__; \
+	} \
+} while(0)
+
+unsigned long long now_ns();
+void stats_begin();
+void stats_end();
+void stats_report(FILE*);
+int io_stats_begin(char*);
+void io_add(int, unsigned long long);
+void io_stats_dump();
+
+#endif // SIMPLELANGSTATS_H
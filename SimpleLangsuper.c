@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "SimpleLang.h"
+#include "SimpleLangsuper.h"
+#include "SimpleLangloop.h"
+#include "SimpleLangdebug.h"
+
+/*** EXTERNAL VARIABLES ***/
+// Fused op control variable, if set to 0 parsed code runs as is
+int superops = 1;
+/**************************/
+
+/*** INTERNAL VARIABLES ***/
+// Shapes of the fused ops, SUPEROP_BASE+i has shape shapes[i]
+static const char *shapes[] = SUPEROP_SHAPES;
+/**************************/
+
+#define MAX_PROFILE 1024 // Most distinct shapes --gen-superops keeps track of
+
+// One element of parsed code, see SimpleLangsuper.h
+struct element {
+	char shape; // The element, or 0 if it can't be part of a fused op
+	int val;    // Its operand
+	int ops;    // How many parsed ops it covers
+	int size;   // How many bytes of parsed code it covers
+};
+
+/* Gets the number of operand bytes a fused op of some shape carries
+ * @param shape The shape
+ * @return The size of the operands (int)
+ */
+int shape_operands(const char *shape) {
+	int size = 0;
+	for(; *shape; shape++) {
+		if(*shape == '+') size += 1;
+		else if(*shape != ',' && *shape != '.') size += sizeof(int);
+	}
+	return size;
+}
+
+/* Reads the element of parsed code that starts at some position
+ * @param buf The parsed code
+ * @param len The length of buf
+ * @param i The position
+ * @param e Where to store the element
+ * @param stops If not NULL, breakpoints that end a run
+ */
+static void decode(char *buf, int len, int i, struct element *e, char *stops) {
+	int j = i;
+	e->val = 0;
+	switch(buf[i]) {
+		case '+': case '-':
+			e->shape = '+';
+			for(; j < len && (buf[j] == '+' || buf[j] == '-') && !stops_inside(stops, i, j+1); j++)
+				e->val += (buf[j] == '+') ? 1 : -1;
+			break;
+		case '<': case '>':
+			// Only one direction, so running off the tape still errors where it should
+			e->shape = '>';
+			for(; j < len && buf[j] == buf[i] && !stops_inside(stops, i, j+1); j++)
+				e->val += (buf[j] == '>') ? 1 : -1;
+			break;
+		case ',': case '.':
+			e->shape = buf[i];
+			j++;
+			break;
+		case '[': case ']':
+			e->shape = buf[i];
+			e->val = *((int*)&buf[i+1]);
+			j += 1 + sizeof(int);
+			break;
+		default:
+			e->shape = 0;
+			j += op_size(&buf[i]);
+			break;
+	}
+	e->size = j-i;
+	e->ops = (e->shape == '+' || e->shape == '>') ? j-i : 1;
+}
+
+/* Checks whether a fused op matches the parsed code at some position
+ * @param buf The parsed code
+ * @param len The length of buf
+ * @param i The position
+ * @param shape The fused op's shape
+ * @param elems Where to store the matched elements
+ * @param stops If not NULL, breakpoints that a match may only start at
+ * @return The number of parsed ops matched, or 0 if it doesn't match (int)
+ */
+static int match(char *buf, int len, int i, const char *shape, struct element *elems, char *stops) {
+	int ops = 0;
+	for(int k = 0; shape[k]; k++) {
+		if(i >= len || (k > 0 && stops != NULL && stops[i])) return 0;
+		decode(buf, len, i, &elems[k], stops);
+		if(elems[k].shape != shape[k]) return 0;
+		ops += elems[k].ops;
+		i += elems[k].size;
+	}
+	return ops;
+}
+
+/* Links a loop start to its end after both have been written
+ * @param out The code
+ * @param open The position of the op holding the loop start, always its first operand
+ * @param close The position of the op holding the loop end
+ * @param addr The position of the loop end's address
+ * @param end The position just after the op holding the loop end
+ */
+static void link_loop(char *out, int open, int close, int addr, int end) {
+	*((int*)&out[addr]) = open-close;
+	*((int*)&out[open+1]) = end-open;
+}
+
+/* Replaces sequences of parsed ops with fused ops, wherever a fused op
+ * covers at least two of them. Loop addresses are rebuilt for the new layout.
+ * @param buf The parsed code, as returned by parse()
+ * @param len The length of buf
+ * @param arr Where to store the new code (created using malloc)
+ * @param map If not NULL, where to store the position in the new code of
+ * 		the op that covers each position of buf
+ * @param stops If not NULL, breakpoints that a fused op may only start at
+ * @return The length of the new code, or MEMORY_ERR (int)
+ */
+int fuse(char *buf, int len, char **arr, int *map, char *stops) {
+	struct element elems[MAX_SHAPE], best[MAX_SHAPE];
+	int o = 0, ops, best_ops, best_id, k, sp = 0, from;
+	int loopstack[MAX_LOOPS];
+
+	// A fused op is at most 3 times the size of the ops it covers
+	char *out = malloc(3 * len + 1);
+	if(out == NULL) return MEMORY_ERR;
+
+	for(int i = 0; i < len; ) {
+		// Find the fused op that covers the most parsed ops here
+		from = i;
+		best_ops = 1;
+		best_id = -1;
+		for(int id = 0; id < NUM_SUPEROPS; id++) {
+			ops = match(buf, len, i, shapes[id], elems, stops);
+			if(ops > best_ops) {
+				best_ops = ops;
+				best_id = id;
+				memcpy(best, elems, sizeof(elems));
+			}
+		}
+
+		if(best_id < 0) {
+			// Copy the op as it is
+			memcpy(&out[o], &buf[i], op_size(&buf[i]));
+			if(buf[i] == '[') {
+				loopstack[sp++] = o;
+			} else if(buf[i] == ']') {
+				sp--;
+				link_loop(out, loopstack[sp], o, o+1, o+1+sizeof(int));
+			}
+			k = op_size(&buf[i]);
+			if(map != NULL) {
+				for(int p = i; p < i+k; p++) map[p] = o;
+			}
+			o += k;
+			i += k;
+			continue;
+		}
+
+		// Write the fused op and its operands
+		int start = o;
+		out[o++] = SUPEROP_BASE + best_id;
+		for(k = 0; shapes[best_id][k]; k++) {
+			i += best[k].size;
+			switch(best[k].shape) {
+				case '+':
+					out[o++] = (char)best[k].val;
+					break;
+				case '>':
+					*((int*)&out[o]) = best[k].val;
+					o += sizeof(int);
+					break;
+				case '[':
+					loopstack[sp++] = start;
+					o += sizeof(int);
+					break;
+				case ']':
+					sp--;
+					link_loop(out, loopstack[sp], start, o, start+1+shape_operands(shapes[best_id]));
+					o += sizeof(int);
+					break;
+			}
+		}
+		if(map != NULL) {
+			for(int p = from; p < i; p++) map[p] = start;
+		}
+	}
+
+	*arr = out;
+	return o;
+}
+
+/* Writes out the ops a fused op covers, for error messages. Each run
+ * shows its direction once, so [<] for a loop that moves left.
+ * @param op The fused op, followed by its operands
+ * @param out Where to store the text, at least MAX_SHAPE+1 chars
+ */
+void superop_text(char *op, char *out) {
+	const char *shape = shapes[(unsigned char)*op - SUPEROP_BASE];
+	char *next = op+1;
+	for(; *shape; shape++) {
+		switch(*shape) {
+			case '+':
+				*out++ = (*next < 0) ? '-' : '+';
+				next += 1;
+				break;
+			case '>':
+				*out++ = (*((int*)next) < 0) ? '<' : '>';
+				next += sizeof(int);
+				break;
+			case '[': case ']':
+				*out++ = *shape;
+				next += sizeof(int);
+				break;
+			default:
+				*out++ = *shape;
+				break;
+		}
+	}
+	*out = '\0';
+}
+
+/* Writes the C handler for a fused op, as one case of SUPEROP_CASES
+ * @param out The generated header
+ * @param id The fused op's number
+ * @param shape Its shape
+ * @param last Set for the last case, which ends the macro
+ */
+static void write_handler(FILE *out, int id, const char *shape, int last) {
+	int k = 0, size = shape_operands(shape), loop_end = (shape[strlen(shape)-1] == ']');
+	fprintf(out, "\tcase SUPEROP_BASE+%d: /* %s */ \\\n", id, shape);
+	for(; *shape; shape++) {
+		switch(*shape) {
+			case '+':
+				fprintf(out, "\t\tmemory[where] += next[%d]; \\\n", k);
+				k += 1;
+				break;
+			case '>':
+				fprintf(out, "\t\twhere += *((int*)&next[%d]); \\\n", k);
+				fprintf(out, "\t\tif(wrap_where()) break; \\\n");
+				k += sizeof(int);
+				break;
+			case ',':
+				fprintf(out, "\t\tread_char(); \\\n");
+				fprintf(out, "\t\tif(where < 0) break; \\\n");
+				fprintf(out, "\t\tSTAT_BYTES(',', 1); \\\n");
+				break;
+			case '.':
+				fprintf(out, "\t\twrite_char(); \\\n");
+				fprintf(out, "\t\tSTAT_BYTES('.', 1); \\\n");
+				break;
+			case '[':
+				fprintf(out, "\t\tif(memory[where] == 0) { \\\n");
+				fprintf(out, "\t\t\toffset = *((int*)&next[%d])-1; \\\n", k);
+				fprintf(out, "\t\t\tbreak; \\\n");
+				fprintf(out, "\t\t} \\\n");
+				fprintf(out, "\t\tif(perf_stats) stat_loops++; \\\n");
+				k += sizeof(int);
+				break;
+			case ']':
+				fprintf(out, "\t\toffset = *((int*)&next[%d])-1; \\\n", k);
+				k += sizeof(int);
+				break;
+		}
+	}
+	// Only skip the operands once every element ran, so an error stops on the op
+	if(!loop_end) fprintf(out, "\t\toffset = %d; \\\n", size);
+	fprintf(out, "\t\tbreak;%s\n", last ? "" : " \\");
+}
+
+// A shape seen while profiling, and how many dispatches fusing it would save
+struct profile {
+	char shape[MAX_SHAPE+1];
+	unsigned long long saved;
+};
+
+/* Sorts profiled shapes, most dispatches saved first
+ */
+static int by_saved(const void *a, const void *b) {
+	const struct profile *x = a, *y = b;
+	if(x->saved == y->saved) return 0;
+	return (x->saved < y->saved) ? 1 : -1;
+}
+
+/* Runs parsed code, counting how often each op runs
+ * @param buf The parsed code
+ * @param len The length of buf
+ * @param hits Where to count, one counter per byte of buf
+ */
+static void profile_run(char *buf, int len, unsigned long long *hits) {
+	for(int i = 0; i < len; i++) {
+		hits[i]++;
+		i += do_op(buf[i], &buf[i+1]);
+		if(where < 0) {
+			fprintf(stderr, "Runtime error at operation %d; %s\n", i-1, get_error(where));
+			return;
+		}
+	}
+}
+
+/* Adds every shape in some parsed code to the profile. A shape runs as
+ * often as its last element, and fusing it saves one dispatch for every
+ * parsed op after the first.
+ * @param buf The parsed code
+ * @param len The length of buf
+ * @param hits How often each op ran
+ * @param prof The profile
+ * @param nprof The number of shapes in prof
+ */
+static void profile_shapes(char *buf, int len, unsigned long long *hits, struct profile *prof, int *nprof) {
+	struct element elems[MAX_SHAPE];
+	int pos[MAX_SHAPE], n, ops, p;
+	char shape[MAX_SHAPE+1];
+
+	for(int i = 0; i < len; ) {
+		decode(buf, len, i, &elems[0], NULL);
+		pos[0] = i;
+		for(n = 1; n < MAX_SHAPE && pos[n-1] + elems[n-1].size < len; n++) {
+			pos[n] = pos[n-1] + elems[n-1].size;
+			decode(buf, len, pos[n], &elems[n], NULL);
+		}
+
+		// Try every shape starting here: [ only first, ] only last
+		ops = 0;
+		for(int k = 0; k < n && elems[k].shape != 0; k++) {
+			if(elems[k].shape == '[' && k > 0) break;
+			shape[k] = elems[k].shape;
+			shape[k+1] = '\0';
+			ops += elems[k].ops;
+			if(ops > 1 && hits[pos[k]] > 0) {
+				for(p = 0; p < *nprof && strcmp(prof[p].shape, shape) != 0; p++);
+				if(p == *nprof && *nprof < MAX_PROFILE) {
+					strcpy(prof[p].shape, shape);
+					prof[p].saved = 0;
+					(*nprof)++;
+				}
+				if(p < *nprof) prof[p].saved += hits[pos[k]] * (ops - 1);
+			}
+			if(elems[k].shape == ']') break;
+		}
+		i += elems[0].size;
+	}
+}
+
+/* Tool mode: runs a corpus of programs, finds the op sequences that run
+ * most often and writes SimpleLangsuperops.h with fused ops for them.
+ * The interpreter must be rebuilt to use the new fused ops.
+ * @param outname The header to write
+ * @param files The programs to run
+ * @param nfiles The number of programs
+ * @return An exit code, 1 for error, 0 for clean exit
+ */
+int gen_superops(char *outname, char **files, int nfiles) {
+	struct profile *prof;
+	int nprof = 0, len, n;
+	char *raw, *buf;
+	unsigned long long *hits;
+	FILE *out;
+
+	prof = malloc(MAX_PROFILE * sizeof(struct profile));
+	if(prof == NULL) {
+		fprintf(stderr, "Error allocating memory.\n");
+		return 1;
+	}
+
+	for(int f = 0; f < nfiles; f++) {
+		raw = read_source(files[f]);
+		if(raw == NULL) continue;
+		buf = NULL;
+		len = parse(raw, &buf);
+		free(raw);
+		if(len < 0) {
+			fprintf(stderr, "Error: %s in '%s'\n", get_error(len), files[f]);
+			free(buf);
+			continue;
+		}
+		// Profile what fuse() will see, after closed forms are swapped in
+		if(closed_loops) {
+			raw = NULL;
+			n = closed_form(buf, len, &raw, NULL, NULL);
+			if(n >= 0) {
+				free(buf);
+				buf = raw;
+				len = n;
+			}
+		}
+		hits = calloc(len+1, sizeof(unsigned long long));
+		if(hits == NULL) {
+			fprintf(stderr, "Error allocating memory.\n");
+			free(buf);
+			continue;
+		}
+
+		// Every program starts on a clean tape
+		reset_tape();
+		profile_run(buf, len, hits);
+		profile_shapes(buf, len, hits, prof, &nprof);
+		cleanup();
+		free(hits);
+		free(buf);
+	}
+
+	qsort(prof, nprof, sizeof(struct profile), by_saved);
+	n = (nprof < MAX_SUPEROPS) ? nprof : MAX_SUPEROPS;
+
+	out = fopen(outname, "w");
+	if(out == NULL) {
+		fprintf(stderr, "Error: file '%s' could not be opened.\n", outname);
+		free(prof);
+		return 1;
+	}
+	fprintf(out, "/* Generated by SimpleLang --gen-superops, do not edit.\n");
+	fprintf(out, " * Corpus:");
+	for(int f = 0; f < nfiles; f++)
+		fprintf(out, " %s", files[f]);
+	fprintf(out, "\n */\n");
+	fprintf(out, "#ifndef SIMPLELANGSUPEROPS_H\n#define SIMPLELANGSUPEROPS_H\n\n");
+	fprintf(out, "#define NUM_SUPEROPS %d\n\n", n);
+
+	fprintf(out, "// Dispatches saved while profiling:\n");
+	for(int i = 0; i < n; i++)
+		fprintf(out, "//   %-4s %llu\n", prof[i].shape, prof[i].saved);
+	fprintf(out, "#define SUPEROP_SHAPES {");
+	for(int i = 0; i < n; i++)
+		fprintf(out, "%s \"%s\"", i ? "," : "", prof[i].shape);
+	fprintf(out, "%s }\n\n", n ? "" : " \"\"");
+
+	fprintf(out, "#define SUPEROP_CASES%s\n", n ? " \\" : "");
+	for(int i = 0; i < n; i++)
+		write_handler(out, i, prof[i].shape, i == n-1);
+	fprintf(out, "\n#endif // SIMPLELANGSUPEROPS_H\n");
+	fclose(out);
+
+	fprintf(stderr, "Wrote %d fused ops to %s\n", n, outname);
+	free(prof);
+	return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef SIMPLELANGSUPER_H
+#define SIMPLELANGSUPER_H
+
+/* Fused ops (superinstructions) replace a short sequence of parsed ops
+ * with a single op. Their shapes and handlers come from the generated
+ * SimpleLangsuperops.h, which is rebuilt with --gen-superops.
+ *
+ * A shape is a string of elements:
+ * 		+	a run of + and -          (1 byte operand, the sum)
+ * 		>	a run of < or > only      (int operand, the distance)
+ * 		,	one ,
+ * 		.	one .
+ * 		[	a loop start, only first  (int operand, the loop address)
+ * 		]	a loop end, only last     (int operand, the loop address)
+ * Operands follow the op in element order, like the address after [ and ].
+ */
+
+#define SUPEROP_BASE  0x01 // First fused opcode, below any printable op
+#define MAX_SUPEROPS  16   // Fused opcodes run from SUPEROP_BASE to 0x10
+#define MAX_SHAPE     3    // Longest shape, in elements
+
+#include "SimpleLangsuperops.h"
+
+// variables defined in SimpleLangsuper.c
+extern int superops;
+
+int shape_operands(const char*);
+void superop_text(char*, char*);
+int fuse(char*, int, char**, int*, char*);
+int gen_superops(char*, char**, int);
+
+#endif // SIMPLELANGSUPER_H
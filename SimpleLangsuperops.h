@@ -0,0 +1,146 @@
+/* Generated by SimpleLang --gen-superops, do not edit.
+ * Corpus: examples/hello.bf examples/rot13.bf
+ */
+#ifndef SIMPLELANGSUPEROPS_H
+#define SIMPLELANGSUPEROPS_H
+
+#define NUM_SUPEROPS 16
+
+// Dispatches saved while profiling:
+//   >+   88
+//   [>]  80
+//   +    56
+//   >+>  56
+//   +>+  56
+//   [>   48
+//   [>+  40
+//   >]   40
+//   +.   34
+//   +.+  33
+//   +>   32
+//   .+.  32
+//   .+   27
+//   +.>  19
+//   >+]  16
+//   .>+  12
+#define SUPEROP_SHAPES { ">+", "[>]", "+", ">+>", "+>+", "[>", "[>+", ">]", "+.", "+.+", "+>", ".+.", ".+", "+.>", ">+]", ".>+" }
+
+#define SUPEROP_CASES \
+	case SUPEROP_BASE+0: /* >+ */ \
+		where += *((int*)&next[0]); \
+		if(wrap_where()) break; \
+		memory[where] += next[4]; \
+		offset = 5; \
+		break; \
+	case SUPEROP_BASE+1: /* [>] */ \
+		if(memory[where] == 0) { \
+			offset = *((int*)&next[0])-1; \
+			break; \
+		} \
+		if(perf_stats) stat_loops++; \
+		where += *((int*)&next[4]); \
+		if(wrap_where()) break; \
+		offset = *((int*)&next[8])-1; \
+		break; \
+	case SUPEROP_BASE+2: /* + */ \
+		memory[where] += next[0]; \
+		offset = 1; \
+		break; \
+	case SUPEROP_BASE+3: /* >+> */ \
+		where += *((int*)&next[0]); \
+		if(wrap_where()) break; \
+		memory[where] += next[4]; \
+		where += *((int*)&next[5]); \
+		if(wrap_where()) break; \
+		offset = 9; \
+		break; \
+	case SUPEROP_BASE+4: /* +>+ */ \
+		memory[where] += next[0]; \
+		where += *((int*)&next[1]); \
+		if(wrap_where()) break; \
+		memory[where] += next[5]; \
+		offset = 6; \
+		break; \
+	case SUPEROP_BASE+5: /* [> */ \
+		if(memory[where] == 0) { \
+			offset = *((int*)&next[0])-1; \
+			break; \
+		} \
+		if(perf_stats) stat_loops++; \
+		where += *((int*)&next[4]); \
+		if(wrap_where()) break; \
+		offset = 8; \
+		break; \
+	case SUPEROP_BASE+6: /* [>+ */ \
+		if(memory[where] == 0) { \
+			offset = *((int*)&next[0])-1; \
+			break; \
+		} \
+		if(perf_stats) stat_loops++; \
+		where += *((int*)&next[4]); \
+		if(wrap_where()) break; \
+		memory[where] += next[8]; \
+		offset = 9; \
+		break; \
+	case SUPEROP_BASE+7: /* >] */ \
+		where += *((int*)&next[0]); \
+		if(wrap_where()) break; \
+		offset = *((int*)&next[4])-1; \
+		break; \
+	case SUPEROP_BASE+8: /* +. */ \
+		memory[where] += next[0]; \
+		write_char(); \
+		STAT_BYTES('.', 1); \
+		offset = 1; \
+		break; \
+	case SUPEROP_BASE+9: /* +.+ */ \
+		memory[where] += next[0]; \
+		write_char(); \
+		STAT_BYTES('.', 1); \
+		memory[where] += next[1]; \
+		offset = 2; \
+		break; \
+	case SUPEROP_BASE+10: /* +> */ \
+		memory[where] += next[0]; \
+		where += *((int*)&next[1]); \
+		if(wrap_where()) break; \
+		offset = 5; \
+		break; \
+	case SUPEROP_BASE+11: /* .+. */ \
+		write_char(); \
+		STAT_BYTES('.', 1); \
+		memory[where] += next[0]; \
+		write_char(); \
+		STAT_BYTES('.', 1); \
+		offset = 1; \
+		break; \
+	case SUPEROP_BASE+12: /* .+ */ \
+		write_char(); \
+		STAT_BYTES('.', 1); \
+		memory[where] += next[0]; \
+		offset = 1; \
+		break; \
+	case SUPEROP_BASE+13: /* +.> */ \
+		memory[where] += next[0]; \
+		write_char(); \
+		STAT_BYTES('.', 1); \
+		where += *((int*)&next[1]); \
+		if(wrap_where()) break; \
+		offset = 5; \
+		break; \
+	case SUPEROP_BASE+14: /* >+] */ \
+		where += *((int*)&next[0]); \
+		if(wrap_where()) break; \
+		memory[where] += next[4]; \
+		offset = *((int*)&next[5])-1; \
+		break; \
+	case SUPEROP_BASE+15: /* .>+ */ \
+		write_char(); \
+		STAT_BYTES('.', 1); \
+		where += *((int*)&next[0]); \
+		if(wrap_where()) break; \
+		memory[where] += next[4]; \
+		offset = 5; \
+		break;
+
+#endif // SIMPLELANGSUPEROPS_H
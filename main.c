@@ -33,13 +33,34 @@
 
 #include "SimpleLang.h"
 #include "SimpleLangpp.h"
+#include "SimpleLangstats.h"
+#include "SimpleLangparse.h"
+#include "SimpleLangsuper.h"
+#include "SimpleLangloop.h"
+#include "SimpleLangnest.h"
+#include "SimpleLangdebug.h"
+#include "SimpleLangfork.h"
+#include "SimpleLangcell.h"
+#include "SimpleLangd.h"
+#include "SimpleLangrr.h"
+#include "SimpleLangbench.h"
+#include "SimpleLanglanes.h"
 
 
 int main(int argc, char *argv[]) {
 	int c;
 	int ret = 0;
 	char fname[128] = {0};
+	char *superops_out = NULL;
+	char *daemon_path = NULL, *submit_path = NULL;
+	int workers = DAEMON_WORKERS;
+	char *rr_file = NULL;
+	char *io_file = NULL;
+	int rr = RR_OFF;
+	int bench = 0;
+	int bits = CELL_BITS;
 	static int console = 1;
+	static int lanes = 0;
 
 	while( 1 ) {
 		static struct option long_options[] = {
@@ -48,7 +69,29 @@ int main(int argc, char *argv[]) {
 			{"SimpleLang++", no_argument, &bfpp, 1},
 			{"help", no_argument, 0, 'h'},
 			{"file", required_argument, 0, 'f'},
+			{"multi-file", no_argument, &multifile, 1},
+			{"block-io", no_argument, &blockio, 1},
+			{"keep-alive", no_argument, &keep_alive, 1},
+			{"connect-timeout", required_argument, 0, 'T'},
+			{"fork", no_argument, 0, 'F'},
 			{"no-oob", no_argument, &oob, 0},
+			{"cell-bits", required_argument, 0, 'c'},
+			{"lanes", no_argument, &lanes, 1},
+			{"perf-stats", optional_argument, 0, 'p'},
+			{"io-stats", required_argument, 0, 'i'},
+			{"break", required_argument, 0, 'b'},
+			{"watch", required_argument, 0, 'W'},
+			{"parse-threads", required_argument, 0, 't'},
+			{"no-superops", no_argument, &superops, 0},
+			{"no-closed-loops", no_argument, &closed_loops, 0},
+			{"no-par-nests", no_argument, &par_nests, 0},
+			{"gen-superops", required_argument, 0, 'g'},
+			{"daemon", required_argument, 0, 'd'},
+			{"workers", required_argument, 0, 'w'},
+			{"submit", required_argument, 0, 's'},
+			{"record", required_argument, 0, 'r'},
+			{"replay", required_argument, 0, 'R'},
+			{"bench-sockets", optional_argument, 0, 'B'},
 			{0, 0, 0, 0}
 		};
 		/* getopt_long stores the option index here. */
@@ -68,8 +111,63 @@ int main(int argc, char *argv[]) {
 			printf("     -h,--help   Shows this help page and exits\n");
 			printf("     --bf++      Enables SimpleLang++ commands\n");
 			printf("     -f file     Runs the SimpleLang(++) source code from the given file\n");
+			printf("     --multi-file\n");
+			printf("                 Enables the SimpleLang++ @ (select file handle) and $ (seek)\n");
+			printf("                 ops, so several files can be open at once\n");
+			printf("     --block-io  Enables the SimpleLang++ { (block read), } (block write) and\n");
+			printf("                 & (send file through socket) ops\n");
+			printf("     --fork      Enables the SimpleLang++ Y (fork a thread) and | (join) ops\n");
+			printf("     --keep-alive\n");
+			printf("                 Keeps client connections that %% closes, and reuses one when\n");
+			printf("                 the program connects to the same host and port again\n");
+			printf("     --connect-timeout ms\n");
+			printf("                 Time %% waits for a connection (default %d, 0 waits as long\n", CONNECT_TIMEOUT);
+			printf("                 as the OS does)\n");
+			printf("     --break n   Stops before the op at character n of the source, where the\n");
+			printf("                 where, print and disp commands can be used (repeatable)\n");
+			printf("     --watch n   Reports every change to cell n (repeatable, Linux x86 only)\n");
 			printf("     --no-oob    Disables out-of-bounds exceptions. This essentially makes\n");
 			printf("                 memory circular (0-1 rolls over to 32,767 and vice versa)\n");
+			printf("     --cell-bits n\n");
+			printf("                 Makes cells n bits wide (8, 16, 32 or 64, default %d). I/O\n", CELL_BITS);
+			printf("                 still moves bytes, see SimpleLangcell.h\n");
+			printf("     --parse-threads n\n");
+			printf("                 Threads used to parse sources over 1 MB, 0 (the default)\n");
+			printf("                 uses one per CPU and 1 always parses serially\n");
+			printf("     --no-superops\n");
+			printf("                 Runs parsed code as is, without fused ops\n");
+			printf("     --no-closed-loops\n");
+			printf("                 Runs loop nests one pass at a time, even when their effect\n");
+			printf("                 has a closed form (see SimpleLangloop.h)\n");
+			printf("     --no-par-nests\n");
+			printf("                 Runs loop nests one after another, even when they touch\n");
+			printf("                 separate cells (see SimpleLangnest.h)\n");
+			printf("     --gen-superops header [files]\n");
+			printf("                 Runs the given programs and writes a header with fused ops\n");
+			printf("                 for their most common op sequences (see SimpleLangsuper.h)\n");
+			printf("     --daemon path\n");
+			printf("                 Serves jobs on the Unix domain socket at path, with a pool of\n");
+			printf("                 pre-forked workers that keep compiled programs between jobs\n");
+			printf("     --workers n Number of daemon workers (default %d)\n", DAEMON_WORKERS);
+			printf("     --submit path\n");
+			printf("                 Runs the -f file on the daemon at path, with stdin as input\n");
+			printf("     --record file\n");
+			printf("                 Logs all input the program reads (stdin, files, sockets)\n");
+			printf("     --replay file\n");
+			printf("                 Feeds a --record log back to the program in place of the\n");
+			printf("                 real input, without opening any files or sockets\n");
+			printf("     --bench-sockets[=n]\n");
+			printf("                 Runs bf++ echo servers against clients over loopback and\n");
+			printf("                 reports throughput, round trip times and syscalls per byte,\n");
+			printf("                 with n messages per connection (default %d)\n", BENCH_MESSAGES);
+			printf("     --lanes     Runs the program once per line of stdin, %d lines at a time\n", LANES);
+			printf("                 in SIMD lanes, and prints each line's output in order\n");
+			printf("     --perf-stats[=json]\n");
+			printf("                 Reports hardware counters and op counts to stderr on exit\n");
+			printf("     --io-stats file\n");
+			printf("                 Times compute against blocking I/O (stdio, files, DNS,\n");
+			printf("                 connect, accept, sockets) with latency histograms, written\n");
+			printf("                 to file on exit and on SIGUSR1\n");
 			return 0;
 			break;
 
@@ -78,6 +176,75 @@ int main(int argc, char *argv[]) {
 			console = 0;
 			break;
 			
+		case 'p':
+			if(optarg != NULL && strcmp(optarg, "json") == 0) {
+				perf_stats = STATS_JSON;
+			} else if(optarg == NULL || strcmp(optarg, "text") == 0) {
+				perf_stats = STATS_TEXT;
+			} else {
+				fprintf(stderr, "Unknown stats format '%s', use text or json\n", optarg);
+				return 1;
+			}
+			break;
+
+		case 'i':
+			io_file = optarg;
+			break;
+
+		case 'F':
+			if(fork_begin() != 0) return 1;
+			break;
+
+		case 'c':
+			bits = atoi(optarg);
+			break;
+
+		case 'T':
+			connect_timeout = atoi(optarg);
+			break;
+
+		case 'b':
+			if(add_break(atol(optarg)) != 0) return 1;
+			break;
+
+		case 'W':
+			if(add_watch(atoi(optarg)) != 0) return 1;
+			break;
+
+		case 'g':
+			superops_out = optarg;
+			break;
+
+		case 't':
+			parse_threads = atoi(optarg);
+			break;
+
+		case 'd':
+			daemon_path = optarg;
+			break;
+
+		case 'w':
+			workers = atoi(optarg);
+			break;
+
+		case 's':
+			submit_path = optarg;
+			break;
+
+		case 'r':
+		case 'R':
+			rr_file = optarg;
+			rr = (c == 'r') ? RR_RECORD : RR_REPLAY;
+			break;
+
+		case 'B':
+			bench = (optarg != NULL) ? atoi(optarg) : BENCH_MESSAGES;
+			if(bench <= 0) {
+				fprintf(stderr, "Bad message count '%s'\n", optarg);
+				return 1;
+			}
+			break;
+
 		case '?':
 			// getopt_long already prints an error message
 			break;
@@ -89,7 +256,48 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if(console) {
+	if(forking && (num_breaks > 0 || watching)) {
+		fprintf(stderr, "--fork can't be used with --break or --watch\n");
+		return 1;
+	}
+
+	if(bits != CELL_BITS) {
+		if(forking || num_breaks > 0 || watching) {
+			fprintf(stderr, "--cell-bits can't be used with --fork, --break or --watch\n");
+			return 1;
+		}
+		if(cell_begin(bits) != 0) return 1;
+	}
+
+	if(rr_file != NULL && rr_open(rr_file, rr) != 0) {
+		return 1;
+	}
+
+	if(io_file != NULL && io_stats_begin(io_file) != 0) {
+		return 1;
+	}
+
+	if(superops_out != NULL) {
+		// Tool mode, profile the corpus without the current fused ops
+		superops = 0;
+		ret = gen_superops(superops_out, &argv[optind], argc-optind);
+	} else if(bench) {
+		ret = bench_sockets(bench);
+	} else if(daemon_path != NULL) {
+		ret = run_daemon(daemon_path, workers);
+	} else if(submit_path != NULL) {
+		if(console) {
+			fprintf(stderr, "--submit needs a program, use -f file\n");
+			return 1;
+		}
+		ret = submit_job(submit_path, fname);
+	} else if(lanes) {
+		if(console || bfpp) {
+			fprintf(stderr, "--lanes needs a SimpleLang program, use -f file without --bf++\n");
+			return 1;
+		}
+		ret = run_lanes(fname);
+	} else if(console) {
 		do_console();
 	} else {
 		ret = do_file(fname);
@@ -100,6 +308,18 @@ int main(int argc, char *argv[]) {
 		cleanup();
 	}
 
+	if(rr_mode) {
+		rr_close();
+	}
+
+	if(perf_stats) {
+		stats_report(stderr);
+	}
+
+	if(io_stats) {
+		io_stats_dump();
+	}
+
 	return ret;
 }
 